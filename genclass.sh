@@ -0,0 +1,34 @@
+#!/bin/sh
+#	$NetBSD$
+#
+# Generate the driver classification table of xdev_class.c together
+# with an order-preserving minimal perfect hash over the driver names.
+#
+# usage: genclass.sh xdev_class.list > xdev_class_hash.h
+
+set -e
+
+: ${TOOL_NBPERF:=nbperf}
+
+list="$1"
+
+strip()
+{
+
+	sed -e 's/#.*//' -e '/^[[:space:]]*$/d' "$list"
+}
+
+echo "/* Generated from ${list##*/} by genclass.sh; DO NOT EDIT. */"
+echo
+echo "static const struct xdev_class xdev_classes[] = {"
+strip | awk '
+NF != 3 {
+	printf("genclass.sh: malformed line: %s\n", $0) > "/dev/stderr"
+	exit 1
+}
+{
+	printf("\t{ \"%s\", %d, \"%s\", \"%s\" },\n", $1, length($1), $2, $3)
+}'
+echo "};"
+echo
+strip | awk '{ print $1 }' | ${TOOL_NBPERF} -s -n xdev_class_hash
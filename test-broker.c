@@ -0,0 +1,175 @@
+/*
+ * Run xdevd(8) on simulated events and check that several monitors,
+ * each in its own process and attached to the ring, all receive every
+ * event in order, also after the broker is restarted and has replaced
+ * the ring.  Takes the path of the xdevd binary.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xdev.h>
+
+#define READERS	4
+#define EVENTS	1000
+#define RING	"test-broker.ring"
+
+static int
+reader(int ready)
+{
+	char want[32];
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		err(EXIT_FAILURE, "xdev_new");
+
+	struct xdev_monitor *monitor = xdev_monitor_new(xdev);
+	if (!monitor)
+		err(EXIT_FAILURE, "xdev_monitor_new");
+
+	if (xdev_monitor_attach_ring(monitor, RING) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_attach_ring");
+	xdev_monitor_enable_receiving(monitor);
+	int fd = xdev_monitor_get_fd(monitor);
+
+	if (write(ready, "1", 1) != 1)
+		err(EXIT_FAILURE, "write");
+
+	for (int i = 0; i < 2 * EVENTS; i++) {
+		struct pollfd pfd[1];
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		if (poll(pfd, 1, 5000) != 1)
+			errx(EXIT_FAILURE, "[%d] %d: no event received",
+			    getpid(), i);
+
+		struct xdev_device *dev = xdev_monitor_receive_device(monitor);
+		if (!dev)
+			err(EXIT_FAILURE, "xdev_monitor_receive_device");
+
+		const char *devname;
+		xdev_device_get_devname(dev, &devname);
+		snprintf(want, sizeof(want), "sim%d", i % EVENTS);
+		if (strcmp(devname, want) != 0)
+			errx(EXIT_FAILURE, "[%d] got %s, expected %s",
+			    getpid(), devname, want);
+		xdev_device_unref(dev);
+	}
+
+	uint64_t lost;
+	if (xdev_monitor_get_lost(monitor, &lost) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_get_lost");
+	if (lost != 0)
+		errx(EXIT_FAILURE, "[%d] %ju events lost", getpid(),
+		    (uintmax_t)lost);
+
+	xdev_monitor_unref(monitor);
+	xdev_unref(xdev);
+
+	return EXIT_SUCCESS;
+}
+
+static pid_t
+broker(const char *xdevd, FILE **fpp)
+{
+	struct stat st;
+	int events[2];
+	pid_t pid;
+
+	if (pipe(events) == -1)
+		err(EXIT_FAILURE, "pipe");
+
+	pid = fork();
+	if (pid == -1)
+		err(EXIT_FAILURE, "fork");
+	if (pid == 0) {
+		dup2(events[0], STDIN_FILENO);
+		close(events[0]);
+		close(events[1]);
+		execl(xdevd, "xdevd", "-s", "-n", "1024", "-r", RING, NULL);
+		err(EXIT_FAILURE, "%s", xdevd);
+	}
+	close(events[0]);
+
+	for (int i = 0; stat(RING, &st) == -1; i++) {
+		if (i == 100)
+			errx(EXIT_FAILURE, "%s did not create %s", xdevd, RING);
+		usleep(10000);
+	}
+
+	*fpp = fdopen(events[1], "w");
+	if (*fpp == NULL)
+		err(EXIT_FAILURE, "fdopen");
+
+	return pid;
+}
+
+static void
+publish(FILE *fp, pid_t pid)
+{
+	int status;
+
+	for (int i = 0; i < EVENTS; i++)
+		fprintf(fp, "device-attach sim%d mainbus0\n", i);
+	fclose(fp);
+
+	waitpid(pid, &status, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *xdevd = argc == 2 ? argv[1] : "xdevd/xdevd";
+	int ready[2];
+	pid_t pid, readers[READERS];
+	int status, failed = 0;
+	FILE *fp;
+	char c;
+
+	if (pipe(ready) == -1)
+		err(EXIT_FAILURE, "pipe");
+
+	unlink(RING);
+
+	pid = broker(xdevd, &fp);
+
+	for (int i = 0; i < READERS; i++) {
+		readers[i] = fork();
+		if (readers[i] == -1)
+			err(EXIT_FAILURE, "fork");
+		if (readers[i] == 0) {
+			fclose(fp);
+			_exit(reader(ready[1]));
+		}
+	}
+
+	for (int i = 0; i < READERS; i++) {
+		if (read(ready[0], &c, 1) != 1)
+			errx(EXIT_FAILURE, "reader died");
+	}
+
+	publish(fp, pid);
+
+	/* The readers are still mapping the ring of the first one. */
+	pid = broker(xdevd, &fp);
+	publish(fp, pid);
+
+	for (int i = 0; i < READERS; i++) {
+		waitpid(readers[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+
+	printf("%d readers, %d events, %d failed\n", READERS, 2 * EVENTS,
+	    failed);
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,73 @@
+/*
+ * Measure what starting and stopping a monitor costs: xdev_monitor_new(),
+ * xdev_monitor_enable_receiving() and the final xdev_monitor_unref(),
+ * first with nothing to reuse and then averaged over CYCLES rounds.
+ */
+#include <sys/types.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <xdev.h>
+
+#define CYCLES	10000
+
+static int
+source_recv(void *cookie, prop_dictionary_t *evp)
+{
+
+	errno = EAGAIN;
+	return -1;
+}
+
+static double
+cycle(struct xdev *xdev, const struct xdev_source *source, int n)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < n; i++) {
+		struct xdev_monitor *monitor = xdev_monitor_new(xdev);
+		if (!monitor)
+			err(EXIT_FAILURE, "xdev_monitor_new");
+		if (xdev_monitor_set_source(monitor, source) == -1)
+			err(EXIT_FAILURE, "xdev_monitor_set_source");
+		if (xdev_monitor_enable_receiving(monitor) == -1)
+			err(EXIT_FAILURE, "xdev_monitor_enable_receiving");
+		xdev_monitor_unref(monitor);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+	    (end.tv_nsec - start.tv_nsec)) / 1e3 / n;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct xdev_source source;
+	int events[2];
+
+	if (pipe2(events, O_NONBLOCK) == -1)
+		err(EXIT_FAILURE, "pipe2");
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		errx(EXIT_FAILURE, "xdev_new");
+
+	source.xs_fd = events[0];
+	source.xs_interval = -1;
+	source.xs_recv = source_recv;
+	source.xs_cookie = NULL;
+
+	printf("first cycle: %.1f us\n", cycle(xdev, &source, 1));
+	printf("%d cycles: %.1f us per cycle\n", CYCLES,
+	    cycle(xdev, &source, CYCLES));
+
+	xdev_unref(xdev);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+/*
+ * Check xdev_enumerate_diff() on two scans of a synthetic device tree
+ * and time it.  DRVLISTDEV and the get-properties command are
+ * interposed to show -n devices (200000 by default) spread over BUSES
+ * buses.  Between the scans some devices are removed, added, moved to
+ * another bus or given a new property value, and each kind has to be
+ * reported exactly as often as it was made.  A moved device reports a
+ * change as well, its device-parent property differs.  Without a
+ * callback the diff has to return the same total.  The devices of the
+ * first scan get their fingerprints before the tree changes; the first
+ * diff fetches the properties of the lazy devices of the second scan,
+ * the diff after it has all fingerprints at hand.
+ */
+#include <sys/types.h>
+#include <sys/drvctlio.h>
+#include <sys/ioctl.h>
+#include <dlfcn.h>
+#include <err.h>
+#include <errno.h>
+#include <prop/proplib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xdev.h>
+
+#define BUSES	64
+
+struct sim {
+	unsigned int bus;
+	unsigned int revision;
+	bool present;
+};
+
+static struct sim *sims;
+static size_t num_sims;
+
+static int (*real_ioctl)(int, unsigned long, ...);
+
+static int
+list(struct devlistargs *laa)
+{
+	unsigned int bus;
+	size_t i, n;
+
+	n = 0;
+	if (laa->l_devname[0] == '\0') {
+		for (bus = 0; bus < BUSES; bus++, n++) {
+			if (n < laa->l_children)
+				snprintf(laa->l_childname[n],
+				    sizeof(laa->l_childname[n]), "bus%u", bus);
+		}
+	} else if (sscanf(laa->l_devname, "bus%u", &bus) == 1) {
+		for (i = 0; i < num_sims; i++) {
+			if (!sims[i].present || sims[i].bus != bus)
+				continue;
+			if (n < laa->l_children)
+				snprintf(laa->l_childname[n],
+				    sizeof(laa->l_childname[n]), "sim%zu", i);
+			n++;
+		}
+	}
+
+	laa->l_children = n;
+	return 0;
+}
+
+int
+ioctl(int fd, unsigned long cmd, ...)
+{
+	va_list ap;
+	void *arg;
+
+	va_start(ap, cmd);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (cmd == DRVLISTDEV)
+		return list(arg);
+
+	if (real_ioctl == NULL)
+		real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+	return real_ioctl(fd, cmd, arg);
+}
+
+int
+prop_dictionary_sendrecv_ioctl(prop_dictionary_t dict, int fd,
+    unsigned long cmd, prop_dictionary_t *dictp)
+{
+	prop_dictionary_t args, data, result;
+	const char *devname;
+	char parent[16];
+	unsigned int bus;
+	size_t i;
+
+	args = prop_dictionary_get(dict, "drvctl-arguments");
+	if (cmd != DRVCTLCOMMAND || args == NULL ||
+	    !prop_dictionary_get_cstring_nocopy(args, "device-name", &devname))
+		return EINVAL;
+
+	result = prop_dictionary_create();
+	data = prop_dictionary_create();
+
+	if (sscanf(devname, "bus%u", &bus) == 1) {
+		prop_dictionary_set_cstring_nocopy(data, "device-driver",
+		    "bus");
+		prop_dictionary_set_uint32(data, "device-unit", bus);
+	} else if (sscanf(devname, "sim%zu", &i) == 1 && i < num_sims &&
+	    sims[i].present) {
+		snprintf(parent, sizeof(parent), "bus%u", sims[i].bus);
+		prop_dictionary_set_cstring_nocopy(data, "device-driver",
+		    "sim");
+		prop_dictionary_set_cstring(data, "device-parent", parent);
+		prop_dictionary_set_uint32(data, "device-unit", (uint32_t)i);
+		prop_dictionary_set_uint32(data, "revision",
+		    sims[i].revision);
+	} else {
+		prop_object_release(data);
+		prop_dictionary_set_int8(result, "drvctl-error", ENXIO);
+		*dictp = result;
+		return 0;
+	}
+
+	prop_dictionary_set(result, "drvctl-result-data", data);
+	prop_object_release(data);
+	prop_dictionary_set_int8(result, "drvctl-error", 0);
+
+	*dictp = result;
+	return 0;
+}
+
+static void
+count(struct xdev_device *dev, int kind, void *cookie)
+{
+	size_t *counts = cookie;
+
+	counts[kind]++;
+}
+
+static struct xdev_enumerate *
+scan(struct xdev *xdev)
+{
+	struct xdev_enumerate *enumerate;
+
+	enumerate = xdev_enumerate_new(xdev);
+	if (!enumerate)
+		err(EXIT_FAILURE, "xdev_enumerate_new");
+	if (xdev_enumerate_set_lazy(enumerate, true) == -1)
+		err(EXIT_FAILURE, "xdev_enumerate_set_lazy");
+	if (xdev_enumerate_scan_devices(enumerate, "", XDEV_INF_DEPTH) == -1)
+		err(EXIT_FAILURE, "xdev_enumerate_scan_devices");
+
+	return enumerate;
+}
+
+static void
+fingerprint(struct xdev_enumerate *enumerate)
+{
+	struct xdev_list_entry *entry;
+	struct xdev_device *dev;
+	uint64_t fp;
+
+	xdev_list_entry_foreach(entry,
+	    xdev_enumerate_get_list_entry(enumerate)) {
+		dev = xdev_list_entry_get_device(entry);
+		if (xdev_device_get_fingerprint(dev, &fp) == -1)
+			err(EXIT_FAILURE, "xdev_device_get_fingerprint");
+		xdev_device_unref(dev);
+	}
+}
+
+static double
+diff(struct xdev_enumerate *a, struct xdev_enumerate *b, size_t *counts)
+{
+	struct timespec start, end;
+
+	memset(counts, 0, 5 * sizeof(*counts));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (xdev_enumerate_diff(a, b, count, counts) == -1)
+		err(EXIT_FAILURE, "xdev_enumerate_diff");
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) +
+	    (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static __dead void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s [-n devices]\n", getprogname());
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	size_t devices, added, removed, reparented, changed, i;
+	size_t counts[5], again[5];
+	double cold, warm;
+	int ch, failed, total;
+
+	devices = 200000;
+
+	while ((ch = getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+		case 'n':
+			devices = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc != optind || devices == 0)
+		usage();
+
+	/* Room for the devices added by the second scan. */
+	num_sims = devices + devices / 100;
+	sims = calloc(num_sims, sizeof(*sims));
+	if (sims == NULL)
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < devices; i++) {
+		sims[i].bus = i % BUSES;
+		sims[i].present = true;
+	}
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		err(EXIT_FAILURE, "xdev_new");
+
+	struct xdev_enumerate *a = scan(xdev);
+	fingerprint(a);
+
+	added = removed = reparented = changed = 0;
+	for (i = 0; i < devices; i++) {
+		if (i % 7 == 0) {
+			sims[i].present = false;
+			removed++;
+			continue;
+		}
+		if (i % 11 == 0) {
+			sims[i].bus = (sims[i].bus + 1) % BUSES;
+			reparented++;
+		}
+		if (i % 13 == 0)
+			sims[i].revision++;
+		if (i % 11 == 0 || i % 13 == 0)
+			changed++;
+	}
+	for (; i < num_sims; i++) {
+		sims[i].bus = i % BUSES;
+		sims[i].present = true;
+		added++;
+	}
+
+	struct xdev_enumerate *b = scan(xdev);
+
+	cold = diff(a, b, counts);
+	warm = diff(a, b, again);
+
+	/* Counting needs no callback. */
+	total = xdev_enumerate_diff(a, b, NULL, NULL);
+	if (total == -1)
+		err(EXIT_FAILURE, "xdev_enumerate_diff");
+
+	printf("%zu devices: %zu added, %zu removed, %zu reparented, "
+	    "%zu changed\n", devices, counts[XDEV_DIFF_ADDED],
+	    counts[XDEV_DIFF_REMOVED], counts[XDEV_DIFF_REPARENTED],
+	    counts[XDEV_DIFF_CHANGED]);
+	printf("diff %.3f s, with fingerprints known %.3f s\n", cold, warm);
+
+	failed = counts[XDEV_DIFF_ADDED] != added ||
+	    counts[XDEV_DIFF_REMOVED] != removed ||
+	    counts[XDEV_DIFF_REPARENTED] != reparented ||
+	    counts[XDEV_DIFF_CHANGED] != changed ||
+	    memcmp(counts, again, sizeof(counts)) != 0 ||
+	    (size_t)total != added + removed + reparented + changed;
+	if (failed)
+		printf("expected %zu added, %zu removed, %zu reparented, "
+		    "%zu changed\n", added, removed, reparented, changed);
+
+	xdev_enumerate_unref(b);
+	xdev_enumerate_unref(a);
+	xdev_unref(xdev);
+	free(sims);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
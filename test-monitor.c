@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,54 @@ filter(struct xdev_device *dev, void *cookie)
 
 }
 
+static bool
+same(const char *info, size_t len, const char *getter)
+{
+
+	return strcmp(info, getter) == 0 && len == strlen(getter);
+}
+
+/*
+ * xdev_device_get_info() has to agree with the single-field getters,
+ * also when it is the one to fetch the properties of a lazy device.
+ */
+static void
+check_info(struct xdev_device *dev, bool info_first)
+{
+	struct xdev_device_info xdi;
+	const char *devname, *driver, *devclass, *devsubclass, *event, *parent;
+	uint32_t unit;
+	devmajor_t cmajor, bmajor;
+
+	if (info_first && xdev_device_get_info(dev, &xdi) == -1)
+		err(EXIT_FAILURE, "xdev_device_get_info");
+
+	if (xdev_device_get_devname(dev, &devname) == -1 ||
+	    xdev_device_get_driver(dev, &driver) == -1 ||
+	    xdev_device_get_devclass(dev, &devclass) == -1 ||
+	    xdev_device_get_devsubclass(dev, &devsubclass) == -1 ||
+	    xdev_device_get_event(dev, &event) == -1 ||
+	    xdev_device_get_parent(dev, &parent) == -1 ||
+	    xdev_device_get_unit(dev, &unit) == -1 ||
+	    xdev_device_get_major(dev, S_IFCHR, &cmajor) == -1 ||
+	    xdev_device_get_major(dev, S_IFBLK, &bmajor) == -1)
+		err(EXIT_FAILURE, "xdev_device_get_*");
+
+	if (!info_first && xdev_device_get_info(dev, &xdi) == -1)
+		err(EXIT_FAILURE, "xdev_device_get_info");
+
+	if (!same(xdi.xdi_devname, xdi.xdi_devname_len, devname) ||
+	    !same(xdi.xdi_driver, xdi.xdi_driver_len, driver) ||
+	    !same(xdi.xdi_devclass, xdi.xdi_devclass_len, devclass) ||
+	    !same(xdi.xdi_devsubclass, xdi.xdi_devsubclass_len, devsubclass) ||
+	    !same(xdi.xdi_event, xdi.xdi_event_len, event) ||
+	    !same(xdi.xdi_parent, xdi.xdi_parent_len, parent) ||
+	    xdi.xdi_unit != unit || xdi.xdi_cmajor != cmajor ||
+	    xdi.xdi_bmajor != bmajor)
+		errx(EXIT_FAILURE, "%s: xdev_device_get_info() differs from "
+		    "the getters", devname);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -70,6 +119,26 @@ main(int argc, char **argv)
 		xdev_device_unref(dev);
 	}
 
+	xdev_list_entry_foreach(entry, head) {
+		struct xdev_device *dev = xdev_list_entry_get_device(entry);
+		check_info(dev, false);
+		xdev_device_unref(dev);
+	}
+
+	struct xdev_enumerate *lazy = xdev_enumerate_new(xdev);
+	if (!lazy)
+		errx(EXIT_FAILURE, "xdev_enumerate_new");
+	xdev_enumerate_set_lazy(lazy, true);
+	xdev_enumerate_scan_devices(lazy, "", -1);
+	xdev_list_entry_foreach(entry, xdev_enumerate_get_list_entry(lazy)) {
+		struct xdev_device *dev = xdev_list_entry_get_device(entry);
+		check_info(dev, true);
+		xdev_device_unref(dev);
+	}
+	xdev_enumerate_unref(lazy);
+
+	printf("Device info checked!\n");
+
 	struct xdev_monitor *monitor;
 
 	/* Test for 10 sec to start-stop the monitor. */
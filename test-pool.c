@@ -0,0 +1,152 @@
+/*
+ * Check that a warmed up monitor in nocopy mode moves events from its
+ * source to the consumer without any heap allocation.  malloc(3) and
+ * friends are interposed to count calls; the allocations made by the
+ * test's own event source (building the dictionaries) are not counted.
+ */
+#include <sys/types.h>
+#include <dlfcn.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <prop/proplib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xdev.h>
+
+#define WARMUP	128
+#define EVENTS	4096
+
+static __thread bool in_source;
+static volatile bool counting;
+static volatile unsigned long allocations;
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+
+static void
+count(void)
+{
+	if (counting && !in_source)
+		__sync_fetch_and_add(&allocations, 1);
+}
+
+void *
+malloc(size_t n)
+{
+	if (real_malloc == NULL)
+		real_malloc = dlsym(RTLD_NEXT, "malloc");
+	count();
+	return real_malloc(n);
+}
+
+void *
+calloc(size_t n, size_t m)
+{
+	if (real_calloc == NULL)
+		real_calloc = dlsym(RTLD_NEXT, "calloc");
+	count();
+	return real_calloc(n, m);
+}
+
+void *
+realloc(void *p, size_t n)
+{
+	if (real_realloc == NULL)
+		real_realloc = dlsym(RTLD_NEXT, "realloc");
+	count();
+	return real_realloc(p, n);
+}
+
+static int
+source_recv(void *cookie, prop_dictionary_t *evp)
+{
+	static unsigned int n;
+	prop_dictionary_t ev;
+	int fd = *(int *)cookie;
+	char c;
+
+	if (read(fd, &c, 1) != 1) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	in_source = true;
+	ev = prop_dictionary_create();
+	prop_dictionary_set_cstring_nocopy(ev, "event",
+	    n++ % 2 ? "device-detach" : "device-attach");
+	prop_dictionary_set_cstring_nocopy(ev, "device", "sd0");
+	prop_dictionary_set_cstring_nocopy(ev, "parent", "scsibus0");
+	in_source = false;
+
+	*evp = ev;
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct xdev_source source;
+	int events[2];
+
+	if (pipe2(events, O_NONBLOCK) == -1)
+		err(EXIT_FAILURE, "pipe2");
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		errx(EXIT_FAILURE, "xdev_new");
+
+	struct xdev_monitor *monitor = xdev_monitor_new(xdev);
+	if (!monitor)
+		errx(EXIT_FAILURE, "xdev_monitor_new");
+
+	memset(&source, 0, sizeof(source));
+	source.xs_fd = events[0];
+	source.xs_recv = source_recv;
+	source.xs_cookie = &events[0];
+
+	if (xdev_monitor_set_source(monitor, &source) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_set_source");
+	xdev_monitor_set_nocopy(monitor, true);
+	xdev_monitor_enable_receiving(monitor);
+	int fd = xdev_monitor_get_fd(monitor);
+
+	for (int i = 0; i < WARMUP + EVENTS; i++) {
+		if (i == WARMUP) {
+			allocations = 0;
+			counting = true;
+		}
+
+		if (write(events[1], "1", 1) != 1)
+			err(EXIT_FAILURE, "write");
+
+		struct pollfd pfd[1];
+		pfd[0].fd = fd;
+		pfd[0].events = POLLIN;
+		if (poll(pfd, 1, 1000) != 1)
+			errx(EXIT_FAILURE, "no event received");
+
+		struct xdev_device *dev = xdev_monitor_receive_device(monitor);
+		if (!dev)
+			err(EXIT_FAILURE, "xdev_monitor_receive_device");
+
+		const char *devname, *event;
+		xdev_device_get_devname(dev, &devname);
+		xdev_device_get_event(dev, &event);
+		xdev_device_unref(dev);
+	}
+
+	counting = false;
+
+	printf("%lu allocations in %d events\n", allocations, EVENTS);
+
+	xdev_monitor_unref(monitor);
+	xdev_unref(xdev);
+
+	return allocations == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
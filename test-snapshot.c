@@ -0,0 +1,303 @@
+/*
+ * Check that xdev_monitor_scan_devices() passes on exactly the events
+ * that are news relative to its snapshot.  DRVLISTDEV is interposed to
+ * show a flat tree of sim devices, and the events come from a source
+ * the test feeds, waiting each time until the monitor has read them.
+ * Events are queued before the scan, while it lists the tree, before
+ * and after the listing, and once the snapshot is taken.  Attaches of
+ * listed devices and detaches of unlisted ones have to be dropped from
+ * both queues, leaving one byte in each pipe per entry.
+ */
+#include <sys/types.h>
+#include <sys/drvctlio.h>
+#include <sys/ioctl.h>
+#include <dlfcn.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <prop/proplib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xdev.h>
+
+#define SIMS	16
+#define EVENTS	32
+
+struct event {
+	const char *event;
+	int sim;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static struct event events[EVENTS];
+static int num_events, next_event;
+static bool idle;
+static bool present[SIMS];
+
+static pthread_t scanner;
+static int listing;
+
+static int (*real_ioctl)(int, unsigned long, ...);
+
+static int failed;
+
+/* Change the tree and wait until the monitor has read the event. */
+static void
+inject(const char *event, int sim)
+{
+
+	pthread_mutex_lock(&mutex);
+	if (num_events == EVENTS)
+		errx(EXIT_FAILURE, "too many events");
+	present[sim] = strcmp(event, "device-attach") == 0;
+	events[num_events].event = event;
+	events[num_events].sim = sim;
+	num_events++;
+	idle = false;
+	while (!idle)
+		pthread_cond_wait(&cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+static int
+source_recv(void *cookie, prop_dictionary_t *evp)
+{
+	prop_dictionary_t ev;
+	struct event *e;
+	char device[16];
+
+	/* The monitor asks again only once the last event is queued. */
+	pthread_mutex_lock(&mutex);
+	if (next_event == num_events) {
+		idle = true;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		errno = EAGAIN;
+		return -1;
+	}
+	e = &events[next_event++];
+	pthread_mutex_unlock(&mutex);
+
+	snprintf(device, sizeof(device), "sim%d", e->sim);
+
+	ev = prop_dictionary_create();
+	if (ev == NULL ||
+	    !prop_dictionary_set_cstring(ev, "event", e->event) ||
+	    !prop_dictionary_set_cstring(ev, "device", device) ||
+	    !prop_dictionary_set_cstring(ev, "parent", ""))
+		errx(EXIT_FAILURE, "prop_dictionary_set_cstring");
+
+	*evp = ev;
+	return 0;
+}
+
+static int
+list(struct devlistargs *laa)
+{
+	bool scanning;
+	size_t n;
+	int i;
+
+	n = 0;
+	if (laa->l_devname[0] == '\0') {
+		scanning = pthread_equal(pthread_self(), scanner);
+
+		/* Changes the listing sees. */
+		if (scanning && listing++ == 0) {
+			inject("device-attach", 11);
+			inject("device-detach", 4);
+		}
+
+		for (i = 0; i < SIMS; i++) {
+			if (!present[i])
+				continue;
+			if (n < laa->l_children)
+				snprintf(laa->l_childname[n],
+				    sizeof(laa->l_childname[n]), "sim%d", i);
+			n++;
+		}
+		laa->l_children = n;
+
+		/* Changes it comes too early for. */
+		if (scanning && listing == 2) {
+			inject("device-detach", 5);
+			inject("device-attach", 12);
+		}
+		return 0;
+	}
+
+	laa->l_children = 0;
+	return 0;
+}
+
+int
+ioctl(int fd, unsigned long cmd, ...)
+{
+	va_list ap;
+	void *arg;
+
+	va_start(ap, cmd);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (cmd == DRVLISTDEV)
+		return list(arg);
+
+	if (real_ioctl == NULL)
+		real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+	return real_ioctl(fd, cmd, arg);
+}
+
+/* Even sims go to the second queue. */
+static int
+even(struct xdev_device *dev, void *cookie)
+{
+	const char *devname;
+	int sim;
+
+	if (xdev_device_get_devname(dev, &devname) == -1 ||
+	    sscanf(devname, "sim%d", &sim) != 1)
+		return 1;
+
+	return sim % 2 == 0 ? 0 : 1;
+}
+
+static int
+pending(struct xdev_monitor *monitor, int q)
+{
+	int n;
+
+	if (ioctl(xdev_monitor_get_queue_fd(monitor, q), FIONREAD, &n) == -1)
+		err(EXIT_FAILURE, "FIONREAD");
+
+	return n;
+}
+
+static void
+expect_pending(struct xdev_monitor *monitor, int q, int n)
+{
+	int bytes;
+
+	bytes = pending(monitor, q);
+	if (bytes != n) {
+		printf("queue %d: %d bytes pending, expected %d\n", q, bytes,
+		    n);
+		failed = 1;
+	}
+}
+
+static void
+expect(struct xdev_monitor *monitor, int q, const char *event, int sim)
+{
+	struct xdev_device *dev;
+	const char *devname, *ev;
+	char name[16];
+
+	snprintf(name, sizeof(name), "sim%d", sim);
+
+	dev = xdev_monitor_receive_queue(monitor, q);
+	if (dev == NULL) {
+		printf("queue %d: nothing, expected %s %s\n", q, event, name);
+		failed = 1;
+		return;
+	}
+
+	if (xdev_device_get_event(dev, &ev) == -1 ||
+	    xdev_device_get_devname(dev, &devname) == -1)
+		err(EXIT_FAILURE, "xdev_device_get_event");
+
+	if (strcmp(ev, event) != 0 || strcmp(devname, name) != 0) {
+		printf("queue %d: %s %s, expected %s %s\n", q, ev, devname,
+		    event, name);
+		failed = 1;
+	}
+
+	xdev_device_unref(dev);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct xdev_source source;
+	int i, n, q;
+
+	for (i = 0; i < 10; i++)
+		present[i] = true;
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		err(EXIT_FAILURE, "xdev_new");
+
+	struct xdev_monitor *monitor = xdev_monitor_new(xdev);
+	if (!monitor)
+		err(EXIT_FAILURE, "xdev_monitor_new");
+
+	source.xs_fd = -1;
+	source.xs_interval = 1;
+	source.xs_recv = source_recv;
+	source.xs_cookie = NULL;
+	if (xdev_monitor_set_source(monitor, &source) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_set_source");
+
+	q = xdev_monitor_add_queue(monitor, 0, even, NULL);
+	if (q == -1)
+		err(EXIT_FAILURE, "xdev_monitor_add_queue");
+
+	if (xdev_monitor_enable_receiving(monitor) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_enable_receiving");
+
+	/* Queued before the scan. */
+	inject("device-attach", 10);
+	inject("device-detach", 3);
+	expect_pending(monitor, 0, 1);
+	expect_pending(monitor, q, 1);
+
+	struct xdev_enumerate *enumerate = xdev_enumerate_new(xdev);
+	if (!enumerate)
+		err(EXIT_FAILURE, "xdev_enumerate_new");
+	if (xdev_enumerate_set_lazy(enumerate, true) == -1)
+		err(EXIT_FAILURE, "xdev_enumerate_set_lazy");
+
+	scanner = pthread_self();
+	n = xdev_monitor_scan_devices(monitor, enumerate, "",
+	    XDEV_INF_DEPTH);
+	if (n == -1)
+		err(EXIT_FAILURE, "xdev_monitor_scan_devices");
+	if (n != 10) {
+		printf("%d devices in the snapshot, expected 10\n", n);
+		failed = 1;
+	}
+
+	/* Only what the listing came too early for is left. */
+	expect_pending(monitor, 0, 1);
+	expect_pending(monitor, q, 1);
+	expect(monitor, 0, "device-detach", 5);
+	expect(monitor, q, "device-attach", 12);
+
+	/* Tracked from now on. */
+	inject("device-attach", 5);
+	inject("device-attach", 0);
+	inject("device-detach", 15);
+	inject("device-detach", 1);
+	inject("device-attach", 14);
+	inject("device-attach", 12);
+	expect_pending(monitor, 0, 2);
+	expect_pending(monitor, q, 1);
+	expect(monitor, 0, "device-attach", 5);
+	expect(monitor, 0, "device-detach", 1);
+	expect(monitor, q, "device-attach", 14);
+	expect_pending(monitor, 0, 0);
+	expect_pending(monitor, q, 0);
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+
+	xdev_enumerate_unref(enumerate);
+	xdev_monitor_unref(monitor);
+	xdev_unref(xdev);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
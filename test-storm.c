@@ -0,0 +1,347 @@
+/*
+ * Drive a monitor with a hotplug storm from a stand-in event source and
+ * report what the pipeline sustains: received events per second, the
+ * latency from injection to xdev_monitor_receive_queue(), events the
+ * monitor had to drop and the peak RSS.  Devices attach in bursts of
+ * -b events and detach again, -d devices round robin, at -r events per
+ * second (0: as fast as possible).  With -c consumers > 1 every
+ * consumer has its own queue and thread, devices are spread over them
+ * by unit number.  The latency includes time spent waiting in the
+ * source, so an unthrottled run shows the backlog.  The peak RSS includes
+ * the 24 bytes per event the benchmark keeps for itself.
+ */
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xdev.h>
+
+#define MAX_CONSUMERS	8	/* queues per monitor */
+#define IDLE_MS		100
+
+struct storm {
+	size_t events;
+	size_t devices;
+	size_t burst;
+	unsigned long rate;
+	int consumers;
+	int fd[2];
+	size_t next;			/* next event to read, source only */
+	struct timespec *sent;
+	uint64_t *latency;		/* by seqnum - 1, UINT64_MAX if lost */
+	volatile int done;
+	struct xdev_monitor *monitor;
+};
+
+struct consumer {
+	struct storm *storm;
+	pthread_t thread;
+	int queue;
+	size_t received;
+	struct timespec last;
+};
+
+static uint64_t
+nsec(const struct timespec *ts)
+{
+
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int
+source_recv(void *cookie, prop_dictionary_t *evp)
+{
+	struct storm *s = cookie;
+	char device[16], parent[16];
+	size_t unit;
+	uint8_t byte;
+
+	if (read(s->fd[0], &byte, 1) != 1) {
+		if (errno == EAGAIN)
+			return -1;
+		errno = EPIPE;
+		return -1;
+	}
+
+	/* Attach all devices, then detach them all, and again. */
+	unit = s->next % s->devices;
+	snprintf(device, sizeof(device), "sd%zu", unit);
+	snprintf(parent, sizeof(parent), "scsibus%zu", unit / 16);
+
+	prop_dictionary_t ev = prop_dictionary_create();
+	if (!ev)
+		return -1;
+	if (!prop_dictionary_set_cstring(ev, "event",
+	    (s->next / s->devices) % 2 ? "device-detach" : "device-attach") ||
+	    !prop_dictionary_set_cstring(ev, "device", device) ||
+	    !prop_dictionary_set_cstring(ev, "parent", parent)) {
+		prop_object_release(ev);
+		return -1;
+	}
+	s->next++;
+
+	*evp = ev;
+	return 0;
+}
+
+static int
+match_unit(struct xdev_device *dev, void *cookie)
+{
+	struct consumer *c = cookie;
+	const char *devname;
+
+	xdev_device_get_devname(dev, &devname);
+
+	return strtoul(devname + 2, NULL, 10) % c->storm->consumers !=
+	    (unsigned long)c->queue;
+}
+
+static void *
+generate(void *arg)
+{
+	struct storm *s = arg;
+	struct timespec start, due, now;
+	static uint8_t bytes[4096];
+	size_t i, n;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < s->events; i += n) {
+		n = s->events - i;
+		if (n > s->burst)
+			n = s->burst;
+		if (n > sizeof(bytes))
+			n = sizeof(bytes);
+
+		if (s->rate > 0) {
+			uint64_t at = nsec(&start) +
+			    i * 1000000000ULL / s->rate;
+			due.tv_sec = at / 1000000000;
+			due.tv_nsec = at % 1000000000;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (nsec(&now) < at)
+				clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				    &due, NULL);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (size_t j = 0; j < n; j++)
+			s->sent[i + j] = now;
+		if (write(s->fd[1], bytes, n) != (ssize_t)n)
+			err(EXIT_FAILURE, "write");
+	}
+
+	return NULL;
+}
+
+static void *
+consume(void *arg)
+{
+	struct consumer *c = arg;
+	struct storm *s = c->storm;
+	struct pollfd pfd[1];
+	struct timespec now;
+	uint64_t seq;
+
+	pfd[0].fd = xdev_monitor_get_queue_fd(s->monitor, c->queue);
+	pfd[0].events = POLLIN;
+
+	for (;;) {
+		int n = poll(pfd, 1, IDLE_MS);
+		if (n == -1)
+			err(EXIT_FAILURE, "poll");
+		if (n == 0) {
+			if (s->done)
+				break;
+			continue;
+		}
+
+		struct xdev_device *dev =
+		    xdev_monitor_receive_queue(s->monitor, c->queue);
+		if (!dev)
+			continue;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		/* The journal numbers events from 1 in the order read. */
+		xdev_device_get_seqnum(dev, &seq);
+		if (seq >= 1 && seq <= s->events)
+			s->latency[seq - 1] =
+			    nsec(&now) - nsec(&s->sent[seq - 1]);
+		xdev_device_unref(dev);
+
+		c->received++;
+		c->last = now;
+	}
+
+	return NULL;
+}
+
+static int
+cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static long long
+number(const char *arg, const char *what)
+{
+	const char *errstr;
+	long long v;
+
+	v = strtonum(arg, 0, INT_MAX, &errstr);
+	if (errstr)
+		errx(EXIT_FAILURE, "%s is %s: %s", what, errstr, arg);
+	return v;
+}
+
+static __dead void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s [-b burst] [-c consumers] [-d devices] "
+	    "[-n events] [-r rate]\n", getprogname());
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct consumer consumers[MAX_CONSUMERS];
+	struct xdev_source source;
+	struct storm s;
+	struct timespec last;
+	struct rusage ru;
+	pthread_t generator;
+	size_t received, i;
+	int ch;
+
+	memset(&s, 0, sizeof(s));
+	s.events = 100000;
+	s.devices = 256;
+	s.burst = 256;
+	s.consumers = 1;
+
+	while ((ch = getopt(argc, argv, "b:c:d:n:r:")) != -1) {
+		switch (ch) {
+		case 'b':
+			s.burst = number(optarg, "burst");
+			break;
+		case 'c':
+			s.consumers = number(optarg, "consumers");
+			break;
+		case 'd':
+			s.devices = number(optarg, "devices");
+			break;
+		case 'n':
+			s.events = number(optarg, "events");
+			break;
+		case 'r':
+			s.rate = number(optarg, "rate");
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc != optind || s.burst == 0 || s.consumers == 0 ||
+	    s.consumers > MAX_CONSUMERS || s.devices == 0 || s.events == 0)
+		usage();
+
+	s.sent = calloc(s.events, sizeof(*s.sent));
+	s.latency = malloc(s.events * sizeof(*s.latency));
+	if (!s.sent || !s.latency)
+		err(EXIT_FAILURE, "malloc");
+	memset(s.latency, 0xff, s.events * sizeof(*s.latency));
+
+	if (pipe(s.fd) == -1)
+		err(EXIT_FAILURE, "pipe");
+	if (fcntl(s.fd[0], F_SETFL, O_NONBLOCK) == -1)
+		err(EXIT_FAILURE, "fcntl");
+
+	struct xdev *xdev = xdev_new();
+	if (!xdev)
+		err(EXIT_FAILURE, "xdev_new");
+
+	s.monitor = xdev_monitor_new(xdev);
+	if (!s.monitor)
+		err(EXIT_FAILURE, "xdev_monitor_new");
+
+	source.xs_fd = s.fd[0];
+	source.xs_interval = -1;
+	source.xs_recv = source_recv;
+	source.xs_cookie = &s;
+	if (xdev_monitor_set_source(s.monitor, &source) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_set_source");
+
+	memset(consumers, 0, sizeof(consumers));
+	for (int k = 0; k < s.consumers; k++) {
+		consumers[k].storm = &s;
+		consumers[k].queue = k;
+		if (k == 0)
+			continue;
+		if (xdev_monitor_add_queue(s.monitor, 0, match_unit,
+		    &consumers[k]) != k)
+			err(EXIT_FAILURE, "xdev_monitor_add_queue");
+	}
+
+	if (xdev_monitor_enable_receiving(s.monitor) == -1)
+		err(EXIT_FAILURE, "xdev_monitor_enable_receiving");
+
+	for (int k = 0; k < s.consumers; k++) {
+		if ((errno = pthread_create(&consumers[k].thread, NULL,
+		    consume, &consumers[k])) != 0)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	if ((errno = pthread_create(&generator, NULL, generate, &s)) != 0)
+		err(EXIT_FAILURE, "pthread_create");
+
+	pthread_join(generator, NULL);
+	s.done = 1;
+
+	received = 0;
+	memset(&last, 0, sizeof(last));
+	for (int k = 0; k < s.consumers; k++) {
+		pthread_join(consumers[k].thread, NULL);
+		received += consumers[k].received;
+		if (nsec(&consumers[k].last) > nsec(&last))
+			last = consumers[k].last;
+	}
+
+	xdev_monitor_unref(s.monitor);
+	xdev_unref(xdev);
+
+	/* Compact the latencies of the events received and sort them. */
+	size_t m = 0;
+	for (i = 0; i < s.events; i++) {
+		if (s.latency[i] != UINT64_MAX)
+			s.latency[m++] = s.latency[i];
+	}
+	qsort(s.latency, m, sizeof(*s.latency), cmp);
+
+	printf("events %zu received %zu dropped %zu consumers %d\n",
+	    s.events, received, s.events - received, s.consumers);
+	if (m > 0) {
+		double secs = (nsec(&last) - nsec(&s.sent[0])) / 1e9;
+		printf("throughput %.0f events/s\n", received / secs);
+		printf("latency p50 %.1f p99 %.1f p999 %.1f max %.1f us\n",
+		    s.latency[m / 2] / 1e3, s.latency[m * 99 / 100] / 1e3,
+		    s.latency[m * 999 / 1000] / 1e3, s.latency[m - 1] / 1e3);
+	}
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		printf("peak rss %ld KB\n", ru.ru_maxrss);
+
+	free(s.sent);
+	free(s.latency);
+
+	return EXIT_SUCCESS;
+}
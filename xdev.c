@@ -34,12 +34,22 @@ __RCSID("$NetBSD$");
 #include <sys/types.h>
 #include <sys/drvctlio.h>
 
+#include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_cache.h"
+#include "xdev_devnode.h"
+#include "xdev_handle.h"
+#include "xdev_intern.h"
+#include "xdev_journal.h"
+#include "xdev_major.h"
 #include "xdev_private.h"
 #include "xdev_utils.h"
 
@@ -53,14 +63,59 @@ xdev_new(void)
 		return NULL;
 
 	x->drvctl_fd = xopen(DRVCTLDEV, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	/* Enough to enumerate; events then come from xdevd(8). */
+	if (x->drvctl_fd == -1 && (errno == EACCES || errno == EPERM))
+		x->drvctl_fd = xopen(DRVCTLDEV,
+			O_RDONLY | O_CLOEXEC | O_NONBLOCK);
 	if (__predict_false(x->drvctl_fd == -1))
 		goto fail;
 
+	if (__predict_false(xdev_cache_init(&x->cache) == -1))
+		goto fail2;
+
+	if (__predict_false(xdev_intern_init(&x->intern) == -1))
+		goto fail3;
+
+	if (__predict_false(xdev_handle_table_init(&x->handles) == -1))
+		goto fail4;
+
+	if (__predict_false(xdev_journal_init(&x->journal) == -1))
+		goto fail5;
+
+	if (__predict_false(xdev_workers_init(&x->workers) == -1))
+		goto fail6;
+
+	if (__predict_false(xdev_devnodes_init(&x->devnodes) == -1))
+		goto fail7;
+
+	if (__predict_false(xdev_majors_init(&x->majors) == -1))
+		goto fail8;
+
+	if (__predict_false(xdev_ancestry_init(&x->ancestry, &x->intern,
+	    x->drvctl_fd) == -1))
+		goto fail9;
+
 	x->refcnt = 1;
 	x->magic = XDEV_MAGIC;
 
 	return x;
 
+fail9:
+	xdev_majors_fini(&x->majors);
+fail8:
+	xdev_devnodes_fini(&x->devnodes);
+fail7:
+	xdev_workers_fini(&x->workers);
+fail6:
+	xdev_journal_fini(&x->journal);
+fail5:
+	xdev_handle_table_fini(&x->handles);
+fail4:
+	xdev_intern_fini(&x->intern);
+fail3:
+	xdev_cache_fini(&x->cache);
+fail2:
+	xclose(x->drvctl_fd);
 fail:
 	free(x);
 
@@ -101,6 +156,14 @@ xdev_unref(struct xdev *x)
 	}
 
 	if (x->refcnt == 1) {
+		xdev_ancestry_fini(&x->ancestry);
+		xdev_majors_fini(&x->majors);
+		xdev_devnodes_fini(&x->devnodes);
+		xdev_workers_fini(&x->workers);
+		xdev_journal_fini(&x->journal);
+		xdev_handle_table_fini(&x->handles);
+		xdev_cache_fini(&x->cache);
+		xdev_intern_fini(&x->intern);
 		xclose(x->drvctl_fd);
 		x->magic = 0xdeadbeef;
 		free(x);
@@ -145,3 +208,140 @@ xdev_set_userdata(struct xdev *x, void *user)
 
 	x->user = user;
 }
+
+int
+xdev_set_cache(struct xdev *x, size_t max_entries, unsigned int ttl_ms)
+{
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_cache_setup(&x->cache, max_entries, ttl_ms);
+}
+
+/*
+ * Keep the last size monitor events for xdev_monitor_replay(), 0 (the
+ * default) keeps none.  Resizing drops the events journaled so far.
+ * The journal is memory of this xdev: it lets a consumer catch up
+ * after an overflow or a late start, not after a restart of its
+ * process, which has to scan again.
+ */
+int
+xdev_set_journal(struct xdev *x, size_t size)
+{
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_journal_setup(&x->journal, size);
+}
+
+/*
+ * Call cb at each stage an event passes through the monitors of x,
+ * with the event's device name and sequence number and the
+ * CLOCK_MONOTONIC time.  Fails with ENOTSUP unless the library is
+ * built with XDEV_TRACE.  Must be set before any monitor receives.
+ */
+int
+xdev_set_trace(struct xdev *x, xdev_trace_cb cb, void *cookie)
+{
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+#ifdef XDEV_TRACE
+	x->trace = cb;
+	x->trace_cookie = cookie;
+
+	return 0;
+#else
+	errno = ENOTSUP;
+	return -1;
+#endif
+}
+
+void
+xdev_trace(struct xdev *x, int stage, const char *devname, uint64_t seq)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	(*x->trace)(stage, devname, seq, &ts, x->trace_cookie);
+}
+
+/*
+ * Drivers, classes, events and parents handed out by xdev_device_get_*()
+ * are interned: equal strings share one pointer for the lifetime of x.
+ * Interning a string here lets callers compare them with == instead of
+ * strcmp(3).  Device names are not interned, hotplug would make the
+ * table grow without bound.
+ */
+const char *
+xdev_intern(struct xdev *x, const char *s)
+{
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(s == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return xdev_intern_string(&x->intern, s);
+}
+
+/*
+ * Called from the monitor thread for every event read from drvctl(4),
+ * before any monitor filter is applied.  Returns the event's sequence
+ * number.
+ */
+uint64_t
+xdev_notify_event(struct xdev *x, prop_dictionary_t ev, const char *event,
+	const char *devname, const char *parent)
+{
+
+	assert(x != NULL);
+	assert(x->magic == XDEV_MAGIC);
+	assert(ev != NULL);
+	assert(event != NULL);
+	assert(devname != NULL);
+	assert(parent != NULL);
+
+	xdev_cache_invalidate(&x->cache, devname);
+	xdev_handle_table_invalidate(&x->handles, devname);
+	xdev_devnodes_invalidate(&x->devnodes, devname);
+	if (strcmp(event, "device-attach") == 0)
+		xdev_majors_invalidate(&x->majors);
+	xdev_ancestry_update(&x->ancestry, event, devname, parent);
+
+	return xdev_journal_append(&x->journal, ev);
+}
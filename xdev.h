@@ -34,19 +34,64 @@
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
+#include <prop/proplib.h>
+#include <stdbool.h>
+#include <time.h>
+
 struct xdev;
+struct xdev_async;
 struct xdev_device;
 struct xdev_enumerate;
 struct xdev_list_entry;
 struct xdev_monitor;
 
+typedef uint32_t xdev_handle_t;
+#define XDEV_HANDLE_INVALID 0
+
+struct xdev_device_info {
+	const char *xdi_devname;
+	const char *xdi_driver;
+	const char *xdi_devclass;
+	const char *xdi_devsubclass;
+	const char *xdi_event;
+	const char *xdi_parent;
+	size_t xdi_devname_len;
+	size_t xdi_driver_len;
+	size_t xdi_devclass_len;
+	size_t xdi_devsubclass_len;
+	size_t xdi_event_len;
+	size_t xdi_parent_len;
+	uint32_t xdi_unit;
+	devmajor_t xdi_cmajor;
+	devmajor_t xdi_bmajor;
+};
+
+#define XDEV_STAMP_READ		0
+#define XDEV_STAMP_QUEUE	1
+#define XDEV_STAMP_RECEIVE	2
+
+#define XDEV_TRACE_READ		0
+#define XDEV_TRACE_FILTER	1
+#define XDEV_TRACE_QUEUE	2
+#define XDEV_TRACE_RECEIVE	3
+typedef void (*xdev_trace_cb)(int, const char *, uint64_t,
+	const struct timespec *, void *);
+
 __BEGIN_DECLS
+/*
+ * Devices must not outlive their xdev: their driver, class, event and
+ * parent strings are interned in it and go with its last reference.
+ */
 struct xdev *xdev_new(void);
 struct xdev *xdev_ref(struct xdev *);
 struct xdev *xdev_unref(struct xdev *);
 
 void *xdev_get_userdata(struct xdev *);
 void xdev_set_userdata(struct xdev *, void *);
+int xdev_set_cache(struct xdev *, size_t, unsigned int);
+int xdev_set_journal(struct xdev *, size_t);
+const char *xdev_intern(struct xdev *, const char *);
+int xdev_set_trace(struct xdev *, xdev_trace_cb, void *);
 
 #define xdev_list_entry_foreach(entry, head) \
 	for (entry = head; entry; entry = xdev_list_entry_get_next(entry))
@@ -56,8 +101,13 @@ struct xdev_device *xdev_list_entry_get_device(struct xdev_list_entry *);
 struct xdev_device *xdev_device_from_node(struct xdev *, devmajor_t, uint32_t,
 	mode_t);
 struct xdev_device *xdev_device_from_devname(struct xdev *, const char *);
+struct xdev_device *xdev_device_from_devnode(struct xdev *, const char *);
+struct xdev_device *xdev_device_from_devt(struct xdev *, mode_t, dev_t);
+int xdev_devices_from_devnames(struct xdev *, const char * const *, size_t,
+	struct xdev_device **, int *);
 struct xdev_device *xdev_device_ref(struct xdev_device *);
 struct xdev_device *xdev_device_unref(struct xdev_device *);
+struct xdev_device *xdev_device_copy(struct xdev_device *);
 struct xdev *xdev_device_get_xdev(struct xdev_device *);
 
 int xdev_device_get_devname(struct xdev_device *, const char **);
@@ -67,10 +117,43 @@ int xdev_device_get_devsubclass(struct xdev_device *, const char **);
 int xdev_device_get_event(struct xdev_device *, const char **);
 int xdev_device_get_parent(struct xdev_device *, const char **);
 int xdev_device_get_unit(struct xdev_device *, uint32_t *);
+int xdev_device_get_seqnum(struct xdev_device *, uint64_t *);
+int xdev_device_get_timestamp(struct xdev_device *, int, struct timespec *);
+int xdev_device_get_fingerprint(struct xdev_device *, uint64_t *);
+ssize_t xdev_device_get_devnodes(struct xdev_device *, char **, size_t);
 int xdev_device_get_major(struct xdev_device *, mode_t, devmajor_t *);
+int xdev_device_get_info(struct xdev_device *, struct xdev_device_info *);
+int xdev_device_is_below(struct xdev_device *, const char *);
 int xdev_device_externalize(struct xdev_device *, const char **);
+int xdev_device_get_property_string(struct xdev_device *, const char *,
+	const char **);
+int xdev_device_get_property_uint(struct xdev_device *, const char *,
+	uint64_t *);
+int xdev_device_get_property_bool(struct xdev_device *, const char *, bool *);
+int xdev_device_get_handle(struct xdev_device *, xdev_handle_t *);
+
+/*
+ * Handles go stale on the events seen by a monitor running on the same
+ * xdev.  Without one they keep resolving to the device as registered;
+ * release them with xdev_handle_release() once done.
+ */
+int xdev_handle_release(struct xdev *, xdev_handle_t);
+struct xdev_device *xdev_handle_get_device(struct xdev *, xdev_handle_t);
+int xdev_handle_get_devname(struct xdev *, xdev_handle_t, char *, size_t);
+int xdev_handle_get_driver(struct xdev *, xdev_handle_t, const char **);
+int xdev_handle_get_devclass(struct xdev *, xdev_handle_t, const char **);
+int xdev_handle_get_devsubclass(struct xdev *, xdev_handle_t, const char **);
+int xdev_handle_get_parent(struct xdev *, xdev_handle_t, const char **);
+int xdev_handle_get_unit(struct xdev *, xdev_handle_t, uint32_t *);
 
 typedef int (*xdev_filter_cb)(struct xdev_device *, void *c);
+typedef int (*xdev_enumerate_cb)(struct xdev_device *, void *c);
+
+#define XDEV_DIFF_ADDED		1
+#define XDEV_DIFF_REMOVED	2
+#define XDEV_DIFF_CHANGED	3
+#define XDEV_DIFF_REPARENTED	4
+typedef void (*xdev_diff_cb)(struct xdev_device *, int, void *);
 
 #define XDEV_INF_DEPTH -1
 
@@ -80,18 +163,62 @@ struct xdev_enumerate *xdev_enumerate_unref(struct xdev_enumerate *);
 struct xdev *xdev_enumerate_get_xdev(struct xdev_enumerate *);
 
 int xdev_enumerate_filter(struct xdev_enumerate *, xdev_filter_cb, void *);
+int xdev_enumerate_set_lazy(struct xdev_enumerate *, bool);
+int xdev_enumerate_set_arena(struct xdev_enumerate *, bool);
 int xdev_enumerate_scan_devices(struct xdev_enumerate *, const char *, int);
+int xdev_enumerate_scan_devices_cb(struct xdev_enumerate *, const char *, int,
+	xdev_enumerate_cb, void *);
+int xdev_enumerate_rescan(struct xdev_enumerate *, const char *, int,
+	xdev_diff_cb, void *);
+int xdev_enumerate_diff(struct xdev_enumerate *, struct xdev_enumerate *,
+	xdev_diff_cb, void *);
 struct xdev_list_entry *xdev_enumerate_get_list_entry(struct xdev_enumerate *);
 
+struct xdev_source {
+	int xs_fd;
+	int xs_interval;
+	int (*xs_recv)(void *, prop_dictionary_t *);
+	void *xs_cookie;
+};
+
 struct xdev_monitor *xdev_monitor_new(struct xdev *x);
 struct xdev_monitor *xdev_monitor_ref(struct xdev_monitor *xm);
 struct xdev_monitor *xdev_monitor_unref(struct xdev_monitor *xm);
 struct xdev *xdev_monitor_get_xdev(struct xdev_monitor *xm);
 
 int xdev_monitor_filter(struct xdev_monitor *, xdev_filter_cb, void *);
+int xdev_monitor_filter_subtree(struct xdev_monitor *, const char *);
+int xdev_monitor_set_nocopy(struct xdev_monitor *, bool);
+int xdev_monitor_set_timestamps(struct xdev_monitor *, bool);
+int xdev_monitor_set_source(struct xdev_monitor *, const struct xdev_source *);
+int xdev_monitor_attach_ring(struct xdev_monitor *, const char *);
+int xdev_monitor_get_lost(struct xdev_monitor *, uint64_t *);
+int xdev_monitor_set_watch(struct xdev_monitor *, unsigned int, unsigned int);
+int xdev_monitor_add_watch(struct xdev_monitor *, const char *);
+int xdev_monitor_remove_watch(struct xdev_monitor *, const char *);
 int xdev_monitor_enable_receiving(struct xdev_monitor *);
+int xdev_monitor_scan_devices(struct xdev_monitor *, struct xdev_enumerate *,
+	const char *, int);
 int xdev_monitor_get_fd(struct xdev_monitor *);
 struct xdev_device *xdev_monitor_receive_device(struct xdev_monitor *);
+int xdev_monitor_add_queue(struct xdev_monitor *, int, xdev_filter_cb, void *);
+int xdev_monitor_add_subtree_queue(struct xdev_monitor *, int, const char *);
+int xdev_monitor_get_queue_fd(struct xdev_monitor *, int);
+struct xdev_device *xdev_monitor_receive_queue(struct xdev_monitor *, int);
+int xdev_monitor_replay(struct xdev_monitor *, uint64_t);
+
+typedef void (*xdev_async_cb)(struct xdev_device *, int, void *);
+
+struct xdev_async *xdev_async_new(struct xdev *, int, size_t);
+struct xdev_async *xdev_async_ref(struct xdev_async *);
+struct xdev_async *xdev_async_unref(struct xdev_async *);
+struct xdev *xdev_async_get_xdev(struct xdev_async *);
+
+int xdev_async_get_fd(struct xdev_async *);
+int xdev_async_submit(struct xdev_async *, const char *, xdev_async_cb, void *,
+	uint64_t *);
+int xdev_async_cancel(struct xdev_async *, uint64_t);
+int xdev_async_drain(struct xdev_async *);
 __END_DECLS
 
 #endif /* !_XDEV_H_ */
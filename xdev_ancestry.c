@@ -0,0 +1,313 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/drvctlio.h>
+#include <sys/ioctl.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_ancestry.h"
+#include "xdev_intern.h"
+
+int
+xdev_ancestry_init(struct xdev_ancestry *xa, struct xdev_intern *xi,
+	int drvctl_fd)
+{
+	int error;
+
+	assert(xa != NULL);
+	assert(xi != NULL);
+
+	memset(xa, 0, sizeof(*xa));
+	xa->intern = xi;
+	xa->drvctl_fd = drvctl_fd;
+
+	error = pthread_mutex_init(&xa->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&xa->parents, 0) == -1)) {
+		pthread_mutex_destroy(&xa->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The map owns the device names.  Parents are interned, being few. */
+static int
+xdev_ancestry_set(struct xdev_ancestry *xa, const char *devname,
+	const char *parent)
+{
+	struct xdev_ancestry_node *node;
+	size_t len;
+
+	node = (struct xdev_ancestry_node *)xdev_hash_get(&xa->parents,
+		devname);
+	if (node != NULL) {
+		node->link.parent = parent;
+		return 0;
+	}
+
+	len = strlen(devname) + 1;
+	node = (struct xdev_ancestry_node *)malloc(sizeof(*node) + len);
+	if (__predict_false(node == NULL))
+		return -1;
+	node->link.parent = parent;
+	memcpy(node->devname, devname, len);
+
+	if (__predict_false(xdev_hash_put(&xa->parents, node->devname,
+	    node) == -1)) {
+		free(node);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+xdev_ancestry_clear(struct xdev_ancestry *xa)
+{
+	struct xdev_hash_entry *e;
+
+	xdev_hash_foreach(e, &xa->parents)
+		free(e->value);
+	xdev_hash_clear(&xa->parents);
+}
+
+void
+xdev_ancestry_fini(struct xdev_ancestry *xa)
+{
+
+	assert(xa != NULL);
+
+	xdev_ancestry_clear(xa);
+	xdev_hash_fini(&xa->parents);
+	pthread_mutex_destroy(&xa->mutex);
+}
+
+static int
+xdev_ancestry_walk(struct xdev_ancestry *xa, const char *devname)
+{
+	struct devlistargs laa;
+	const char *parent;
+	size_t i, children;
+	int ret;
+
+	memset(&laa, 0, sizeof(laa));
+	strlcpy(laa.l_devname, devname, sizeof(laa.l_devname));
+
+retry:
+	if (__predict_false(ioctl(xa->drvctl_fd, DRVLISTDEV, &laa) == -1))
+		goto fail;
+
+	if ((children = laa.l_children) == 0)
+		goto end;
+
+	ret = reallocarr(&laa.l_childname, children,
+		sizeof(laa.l_childname[0]));
+	if (__predict_false(ret != 0)) {
+		errno = ret;
+		goto fail;
+	}
+
+	if (__predict_false(ioctl(xa->drvctl_fd, DRVLISTDEV, &laa) == -1))
+		goto fail;
+
+	if (__predict_false(laa.l_children != children))
+		goto retry;
+
+	parent = xdev_intern_string(xa->intern, devname);
+	if (__predict_false(parent == NULL))
+		goto fail;
+
+	for (i = 0; i < children; i++) {
+		if (__predict_false(xdev_ancestry_set(xa, laa.l_childname[i],
+		    parent) == -1))
+			goto fail;
+		if (__predict_false(xdev_ancestry_walk(xa,
+		    laa.l_childname[i]) == -1))
+			goto fail;
+	}
+
+end:
+	free(laa.l_childname);
+	return 0;
+
+fail:
+	free(laa.l_childname);
+	return -1;
+}
+
+/* Called with the mutex held. */
+static int
+xdev_ancestry_build(struct xdev_ancestry *xa)
+{
+
+	if (__predict_false(xdev_ancestry_walk(xa, "") == -1)) {
+		xdev_ancestry_clear(xa);
+		return -1;
+	}
+
+	xa->built = true;
+
+	return 0;
+}
+
+/*
+ * Apply an event.  Until the map is built there is nothing to keep
+ * current: building it later sees the result.
+ */
+void
+xdev_ancestry_update(struct xdev_ancestry *xa, const char *event,
+	const char *devname, const char *parent)
+{
+	const char *p;
+
+	assert(xa != NULL);
+	assert(event != NULL);
+	assert(devname != NULL);
+	assert(parent != NULL);
+
+	pthread_mutex_lock(&xa->mutex);
+	if (!xa->built)
+		goto out;
+
+	if (strcmp(event, "device-attach") == 0) {
+		p = xdev_intern_string(xa->intern, parent);
+		/* Without memory the map is only right again once rebuilt. */
+		if (__predict_false(p == NULL ||
+		    xdev_ancestry_set(xa, devname, p) == -1)) {
+			xdev_ancestry_clear(xa);
+			xa->built = false;
+		}
+	} else if (strcmp(event, "device-detach") == 0) {
+		free(xdev_hash_remove(&xa->parents, devname));
+	}
+
+out:
+	pthread_mutex_unlock(&xa->mutex);
+}
+
+/*
+ * Take over the topology of an enumeration, which maps device names to
+ * links to their parents.  A complete one, of the whole tree, builds
+ * the map; a partial one only refreshes a built map.
+ */
+void
+xdev_ancestry_merge(struct xdev_ancestry *xa, const struct xdev_hash *topology,
+	bool complete)
+{
+	const struct xdev_ancestry_link *link;
+	struct xdev_hash_entry *e;
+
+	assert(xa != NULL);
+	assert(topology != NULL);
+
+	pthread_mutex_lock(&xa->mutex);
+	if (!xa->built && !complete)
+		goto out;
+
+	if (complete)
+		xdev_ancestry_clear(xa);
+
+	xdev_hash_foreach(e, topology) {
+		link = (const struct xdev_ancestry_link *)e->value;
+		if (link->parent == NULL)
+			continue;
+		if (__predict_false(xdev_ancestry_set(xa, e->key,
+		    link->parent) == -1)) {
+			xdev_ancestry_clear(xa);
+			xa->built = false;
+			goto out;
+		}
+	}
+	xa->built = true;
+
+out:
+	pthread_mutex_unlock(&xa->mutex);
+}
+
+/*
+ * Whether the device devname, whose parent is parent, is root or lies
+ * below it; every device lies below "", the root of the tree.  The
+ * parent is passed in so that a device just detached, and already gone
+ * from the map, is still placed.  Returns 1 if so, 0 if not and -1 if
+ * the map could not be built.
+ */
+int
+xdev_ancestry_is_below(struct xdev_ancestry *xa, const char *devname,
+	const char *parent, const char *root)
+{
+	const struct xdev_ancestry_node *node;
+	const char *name;
+	int depth;
+
+	assert(xa != NULL);
+	assert(devname != NULL);
+	assert(parent != NULL);
+	assert(root != NULL);
+
+	if (root[0] == '\0' || strcmp(devname, root) == 0)
+		return 1;
+
+	pthread_mutex_lock(&xa->mutex);
+	if (!xa->built &&
+	    __predict_false(xdev_ancestry_build(xa) == -1)) {
+		pthread_mutex_unlock(&xa->mutex);
+		return -1;
+	}
+
+	name = parent;
+	for (depth = 0; depth < XDEV_ANCESTRY_MAX_DEPTH; depth++) {
+		if (name == NULL || name[0] == '\0')
+			break;
+		if (strcmp(name, root) == 0) {
+			pthread_mutex_unlock(&xa->mutex);
+			return 1;
+		}
+		node = (const struct xdev_ancestry_node *)xdev_hash_get(
+			&xa->parents, name);
+		name = node != NULL ? node->link.parent : NULL;
+	}
+	pthread_mutex_unlock(&xa->mutex);
+
+	return 0;
+}
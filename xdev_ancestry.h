@@ -0,0 +1,85 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_ANCESTRY_H_
+#define _XDEV_ANCESTRY_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "xdev_hash.h"
+
+/* Deeper chains are taken for a loop in a stale map. */
+#define XDEV_ANCESTRY_MAX_DEPTH 64
+
+struct xdev_intern;
+
+/*
+ * What the topology of an enumeration maps device names to, see
+ * xdev_ancestry_merge().
+ */
+struct xdev_ancestry_link {
+	const char *parent;		/* interned, NULL if unknown */
+};
+
+struct xdev_ancestry_node {
+	struct xdev_ancestry_link link;
+	char devname[];
+};
+
+/*
+ * The parent of every device, to answer whether one lies below another
+ * without asking drvctl(4).  Built by one DRVLISTDEV walk on first use,
+ * or taken over from a full enumeration, then kept current by attach
+ * and detach events.
+ */
+struct xdev_ancestry {
+	pthread_mutex_t mutex;
+	struct xdev_intern *intern;
+	int drvctl_fd;
+	bool built;
+	struct xdev_hash parents;	/* devname -> node */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_ancestry_init(struct xdev_ancestry *, struct xdev_intern *, int);
+void xdev_ancestry_fini(struct xdev_ancestry *);
+void xdev_ancestry_update(struct xdev_ancestry *, const char *, const char *,
+	const char *);
+void xdev_ancestry_merge(struct xdev_ancestry *, const struct xdev_hash *,
+	bool);
+int xdev_ancestry_is_below(struct xdev_ancestry *, const char *,
+	const char *, const char *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_ANCESTRY_H_ */
@@ -0,0 +1,201 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/atomic.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_arena.h"
+
+#define XDEV_ARENA_ALIGN	sizeof(uint64_t)
+
+void
+xdev_arena_init(struct xdev_arena *xa)
+{
+
+	assert(xa != NULL);
+
+	xa->chunks = NULL;
+	xa->hold = NULL;
+}
+
+static void
+xdev_arena_free_chunks(struct xdev_arena_chunk *c)
+{
+	struct xdev_arena_chunk *next;
+
+	for (; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+}
+
+void
+xdev_arena_fini(struct xdev_arena *xa)
+{
+
+	assert(xa != NULL);
+
+	xdev_arena_free_chunks(xa->chunks);
+	free(xa->hold);
+
+	xa->chunks = NULL;
+	xa->hold = NULL;
+}
+
+/*
+ * Free everything allocated, keeping the current chunk for reuse so
+ * that a scan of the same size as the last one starts out warm.
+ */
+void
+xdev_arena_reset(struct xdev_arena *xa)
+{
+	struct xdev_arena_chunk *c;
+
+	assert(xa != NULL);
+
+	if (xa->chunks == NULL)
+		return;
+
+	while ((c = xa->chunks->next) != NULL) {
+		xa->chunks->next = c->next;
+		free(c);
+	}
+	xa->chunks->used = 0;
+}
+
+/*
+ * Zeroed memory for size bytes, aligned for any member of the library's
+ * structures.  Requests larger than a quarter chunk get a chunk of their
+ * own, behind the current one, so as not to waste what is left of it.
+ */
+void *
+xdev_arena_alloc(struct xdev_arena *xa, size_t size)
+{
+	struct xdev_arena_chunk *c;
+	size_t csize;
+	void *p;
+
+	assert(xa != NULL);
+
+	size = (size + XDEV_ARENA_ALIGN - 1) & ~(XDEV_ARENA_ALIGN - 1);
+
+	c = xa->chunks;
+	if (c == NULL || c->size - c->used < size) {
+		/* Detaching must not fail, it happens on release. */
+		if (xa->hold == NULL) {
+			xa->hold = (struct xdev_arena_hold *)malloc(
+				sizeof(*xa->hold));
+			if (__predict_false(xa->hold == NULL))
+				return NULL;
+		}
+
+		csize = XDEV_ARENA_CHUNK_SIZE;
+		if (size > csize / 4)
+			csize = size;
+		c = (struct xdev_arena_chunk *)malloc(sizeof(*c) + csize);
+		if (__predict_false(c == NULL))
+			return NULL;
+		c->size = csize;
+		c->used = 0;
+		if (csize == size && xa->chunks != NULL) {
+			c->next = xa->chunks->next;
+			xa->chunks->next = c;
+		} else {
+			c->next = xa->chunks;
+			xa->chunks = c;
+		}
+	}
+
+	p = c->data + c->used;
+	c->used += size;
+	memset(p, 0, size);
+
+	return p;
+}
+
+/*
+ * Take all chunks off xa, leaving it empty, for allocations that have
+ * to outlive its next reset.  The hold starts out with one reference;
+ * the chunks are freed with its last.  NULL if xa has no chunks.
+ */
+struct xdev_arena_hold *
+xdev_arena_detach(struct xdev_arena *xa)
+{
+	struct xdev_arena_hold *h;
+
+	assert(xa != NULL);
+
+	if (xa->chunks == NULL)
+		return NULL;
+
+	assert(xa->hold != NULL);
+
+	h = xa->hold;
+	h->refcnt = 1;
+	h->chunks = xa->chunks;
+
+	xa->chunks = NULL;
+	xa->hold = NULL;
+
+	return h;
+}
+
+void
+xdev_arena_hold_ref(struct xdev_arena_hold *h)
+{
+
+	assert(h != NULL);
+
+	atomic_inc_uint(&h->refcnt);
+}
+
+void
+xdev_arena_hold_unref(struct xdev_arena_hold *h)
+{
+
+	assert(h != NULL);
+
+	membar_exit();
+	if (atomic_dec_uint_nv(&h->refcnt) > 0)
+		return;
+	membar_enter();
+
+	xdev_arena_free_chunks(h->chunks);
+	free(h);
+}
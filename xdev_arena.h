@@ -0,0 +1,74 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_ARENA_H_
+#define _XDEV_ARENA_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#define XDEV_ARENA_CHUNK_SIZE	(64 * 1024)
+
+struct xdev_arena_chunk {
+	struct xdev_arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/*
+ * Chunks taken off an arena while some of what was allocated from them
+ * is still in use, freed with the last reference.
+ */
+struct xdev_arena_hold {
+	volatile unsigned int refcnt;
+	struct xdev_arena_chunk *chunks;
+};
+
+/*
+ * Bump allocator: memory is handed out from large chunks and only
+ * given back all at once.
+ */
+struct xdev_arena {
+	struct xdev_arena_chunk *chunks;	/* current first */
+	struct xdev_arena_hold *hold;		/* set with the first chunk */
+};
+
+__BEGIN_HIDDEN_DECLS
+void xdev_arena_init(struct xdev_arena *);
+void xdev_arena_fini(struct xdev_arena *);
+void xdev_arena_reset(struct xdev_arena *);
+void *xdev_arena_alloc(struct xdev_arena *, size_t);
+struct xdev_arena_hold *xdev_arena_detach(struct xdev_arena *);
+void xdev_arena_hold_ref(struct xdev_arena_hold *);
+void xdev_arena_hold_unref(struct xdev_arena_hold *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_ARENA_H_ */
@@ -0,0 +1,456 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xdev.h"
+#include "xdev_async.h"
+#include "xdev_device.h"
+#include "xdev_private.h"
+#include "xdev_utils.h"
+
+const static uint8_t one = '1';
+
+static void
+xdev_async_request_free(struct xdev_async_request *xar)
+{
+
+	if (xar->device != NULL)
+		xdev_device_unref(xar->device);
+	free(xar->devname);
+	free(xar);
+}
+
+static void
+xdev_async_queue_free(struct xdev_async_queue *q)
+{
+	struct xdev_async_request *xar;
+
+	while ((xar = TAILQ_FIRST(q)) != NULL) {
+		TAILQ_REMOVE(q, xar, link);
+		xdev_async_request_free(xar);
+	}
+}
+
+static void *
+xdev_async_thread(void *arg)
+{
+	struct xdev_async *xa;
+	struct xdev_async_request *xar;
+	struct xdev_device *xd;
+	prop_dictionary_t c;
+	int error;
+
+	assert(arg != NULL);
+
+	xa = (struct xdev_async *)arg;
+	c = NULL;
+
+	assert(xa->magic == XDEV_ASYNC_MAGIC);
+
+	pthread_mutex_lock(&xa->mutex);
+	for (;;) {
+		while (!xa->shutdown && TAILQ_EMPTY(&xa->pending))
+			pthread_cond_wait(&xa->cond, &xa->mutex);
+
+		if (xa->shutdown)
+			break;
+
+		xar = TAILQ_FIRST(&xa->pending);
+		TAILQ_REMOVE(&xa->pending, xar, link);
+		TAILQ_INSERT_TAIL(&xa->running, xar, link);
+		pthread_mutex_unlock(&xa->mutex);
+
+		/* The request template is private to this worker. */
+		xd = xdev_device_lookup(xa->xdev, &c, xar->devname);
+		error = xd == NULL ? errno : 0;
+
+		pthread_mutex_lock(&xa->mutex);
+		TAILQ_REMOVE(&xa->running, xar, link);
+		xar->device = xd;
+		xar->error = error;
+
+		if (xar->cancelled) {
+			xa->inflight--;
+			xdev_async_request_free(xar);
+			continue;
+		}
+
+		TAILQ_INSERT_TAIL(&xa->done, xar, link);
+		xwrite(xa->pipe_fd[1], &one, 1);
+	}
+	pthread_mutex_unlock(&xa->mutex);
+
+	if (c != NULL)
+		prop_object_release(c);
+
+	return NULL;
+}
+
+static void
+xdev_async_stop(struct xdev_async *xa, int nthreads)
+{
+	int i;
+
+	pthread_mutex_lock(&xa->mutex);
+	xa->shutdown = true;
+	pthread_cond_broadcast(&xa->cond);
+	pthread_mutex_unlock(&xa->mutex);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(xa->threads[i], NULL);
+}
+
+struct xdev_async *
+xdev_async_new(struct xdev *x, int nthreads, size_t max_inflight)
+{
+	struct xdev_async *xa;
+	int i;
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(nthreads < 1 || max_inflight == 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	xa = (struct xdev_async *)calloc(sizeof(*xa), 1);
+	if (__predict_false(xa == NULL))
+		return NULL;
+
+	xa->threads = (pthread_t *)calloc(nthreads, sizeof(xa->threads[0]));
+	if (__predict_false(xa->threads == NULL))
+		goto fail;
+
+	if (__predict_false(pipe2(xa->pipe_fd, O_CLOEXEC | O_NONBLOCK) == -1))
+		goto fail2;
+
+	if (__predict_false(pthread_mutex_init(&xa->mutex, NULL) != 0))
+		goto fail3;
+
+	if (__predict_false(pthread_cond_init(&xa->cond, NULL) != 0))
+		goto fail4;
+
+	xa->refcnt = 1;
+	xa->magic = XDEV_ASYNC_MAGIC;
+	xa->xdev = x;
+	xa->max_inflight = max_inflight;
+	TAILQ_INIT(&xa->pending);
+	TAILQ_INIT(&xa->running);
+	TAILQ_INIT(&xa->done);
+
+	for (i = 0; i < nthreads; i++) {
+		if (__predict_false(pthread_create(&xa->threads[i], NULL,
+		    xdev_async_thread, xa) != 0))
+			goto fail5;
+	}
+	xa->nthreads = nthreads;
+
+	return xa;
+
+fail5:
+	xdev_async_stop(xa, i);
+	pthread_cond_destroy(&xa->cond);
+fail4:
+	pthread_mutex_destroy(&xa->mutex);
+fail3:
+	xclose(xa->pipe_fd[0]);
+	xclose(xa->pipe_fd[1]);
+fail2:
+	free(xa->threads);
+fail:
+	free(xa);
+
+	return NULL;
+}
+
+struct xdev_async *
+xdev_async_ref(struct xdev_async *xa)
+{
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	xa->refcnt++;
+
+	return xa;
+}
+
+struct xdev_async *
+xdev_async_unref(struct xdev_async *xa)
+{
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (xa->refcnt == 1) {
+		/* Requests still queued are dropped without a callback. */
+		xdev_async_stop(xa, xa->nthreads);
+		assert(TAILQ_EMPTY(&xa->running));
+		xdev_async_queue_free(&xa->pending);
+		xdev_async_queue_free(&xa->done);
+		pthread_cond_destroy(&xa->cond);
+		pthread_mutex_destroy(&xa->mutex);
+		xclose(xa->pipe_fd[0]);
+		xclose(xa->pipe_fd[1]);
+		free(xa->threads);
+		xa->magic = 0xdeadbeef;
+		free(xa);
+		return NULL;
+	}
+
+	xa->refcnt--;
+
+	return xa;
+}
+
+struct xdev *
+xdev_async_get_xdev(struct xdev_async *xa)
+{
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return xa->xdev;
+}
+
+int
+xdev_async_get_fd(struct xdev_async *xa)
+{
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xa->pipe_fd[0];
+}
+
+/*
+ * Queue a lookup of devname.  Fails with EAGAIN once max_inflight
+ * requests are submitted and not yet drained.
+ */
+int
+xdev_async_submit(struct xdev_async *xa, const char *devname,
+	xdev_async_cb cb, void *cb_cookie, uint64_t *idp)
+{
+	struct xdev_async_request *xar;
+
+	if (__predict_false(xa == NULL || devname == NULL || cb == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xar = (struct xdev_async_request *)calloc(sizeof(*xar), 1);
+	if (__predict_false(xar == NULL))
+		return -1;
+
+	xar->devname = strdup(devname);
+	if (__predict_false(xar->devname == NULL)) {
+		free(xar);
+		return -1;
+	}
+
+	xar->cb = cb;
+	xar->cb_cookie = cb_cookie;
+
+	pthread_mutex_lock(&xa->mutex);
+	if (xa->inflight >= xa->max_inflight) {
+		pthread_mutex_unlock(&xa->mutex);
+		xdev_async_request_free(xar);
+		errno = EAGAIN;
+		return -1;
+	}
+	xar->id = ++xa->next_id;
+	TAILQ_INSERT_TAIL(&xa->pending, xar, link);
+	xa->inflight++;
+	pthread_cond_signal(&xa->cond);
+	if (idp != NULL)
+		*idp = xar->id;
+	pthread_mutex_unlock(&xa->mutex);
+
+	return 0;
+}
+
+static struct xdev_async_request *
+xdev_async_find(struct xdev_async_queue *q, uint64_t id)
+{
+	struct xdev_async_request *xar;
+
+	TAILQ_FOREACH(xar, q, link) {
+		if (xar->id == id)
+			return xar;
+	}
+
+	return NULL;
+}
+
+/*
+ * Cancel a request.  Its callback is never called, a lookup already in
+ * progress is discarded when it completes.
+ */
+int
+xdev_async_cancel(struct xdev_async *xa, uint64_t id)
+{
+	struct xdev_async_request *xar;
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&xa->mutex);
+	if ((xar = xdev_async_find(&xa->pending, id)) != NULL) {
+		TAILQ_REMOVE(&xa->pending, xar, link);
+	} else if ((xar = xdev_async_find(&xa->done, id)) != NULL) {
+		TAILQ_REMOVE(&xa->done, xar, link);
+	} else if ((xar = xdev_async_find(&xa->running, id)) != NULL) {
+		if (xar->cancelled)
+			goto notfound;
+		xar->cancelled = true;
+		pthread_mutex_unlock(&xa->mutex);
+		return 0;
+	} else {
+		goto notfound;
+	}
+	xa->inflight--;
+	pthread_mutex_unlock(&xa->mutex);
+
+	xdev_async_request_free(xar);
+	return 0;
+
+notfound:
+	pthread_mutex_unlock(&xa->mutex);
+	errno = ENOENT;
+	return -1;
+}
+
+/*
+ * Run the callbacks of all the completed requests in the calling
+ * thread.  Never blocks.  Returns the number of callbacks called.
+ */
+int
+xdev_async_drain(struct xdev_async *xa)
+{
+	struct xdev_async_queue done;
+	struct xdev_async_request *xar;
+	uint8_t buf[64];
+	int n;
+
+	if (__predict_false(xa == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xa->magic != XDEV_ASYNC_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (xread(xa->pipe_fd[0], buf, sizeof(buf)) > 0)
+		continue;
+
+	TAILQ_INIT(&done);
+
+	pthread_mutex_lock(&xa->mutex);
+	while ((xar = TAILQ_FIRST(&xa->done)) != NULL) {
+		TAILQ_REMOVE(&xa->done, xar, link);
+		TAILQ_INSERT_TAIL(&done, xar, link);
+		xa->inflight--;
+	}
+	pthread_mutex_unlock(&xa->mutex);
+
+	n = 0;
+	while ((xar = TAILQ_FIRST(&done)) != NULL) {
+		TAILQ_REMOVE(&done, xar, link);
+		xar->cb(xar->device, xar->error, xar->cb_cookie);
+		xdev_async_request_free(xar);
+		n++;
+	}
+
+	return n;
+}
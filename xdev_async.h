@@ -0,0 +1,73 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_ASYNC_H_
+#define _XDEV_ASYNC_H_
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "xdev.h"
+
+#define XDEV_ASYNC_MAGIC 0x5e1c0a37
+
+struct xdev_async_request {
+	TAILQ_ENTRY(xdev_async_request) link;
+	uint64_t id;
+	char *devname;
+	xdev_async_cb cb;
+	void *cb_cookie;
+	struct xdev_device *device;
+	int error;
+	bool cancelled;
+};
+TAILQ_HEAD(xdev_async_queue, xdev_async_request);
+
+struct xdev_async {
+	int refcnt;
+	int magic;
+	struct xdev *xdev;
+	struct xdev_async_queue pending;	/* waiting for a worker */
+	struct xdev_async_queue running;	/* owned by a worker */
+	struct xdev_async_queue done;		/* waiting for a drain */
+	size_t inflight;			/* submitted, not drained */
+	size_t max_inflight;
+	uint64_t next_id;
+	bool shutdown;
+	int pipe_fd[2];
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+#endif /* !_XDEV_ASYNC_H_ */
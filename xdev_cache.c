@@ -0,0 +1,259 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/time.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xdev.h"
+#include "xdev_cache.h"
+#include "xdev_device.h"
+#include "xdev_hash.h"
+
+static void
+xdev_cache_entry_free(struct xdev_cache *c, struct xdev_cache_entry *ce)
+{
+
+	xdev_hash_remove(&c->index, ce->devname);
+	TAILQ_REMOVE(&c->lru, ce, lru);
+	c->num_entries--;
+
+	if (ce->device != NULL)
+		xdev_device_unref(ce->device);
+	free(ce->devname);
+	free(ce);
+}
+
+static void
+xdev_cache_flush(struct xdev_cache *c)
+{
+	struct xdev_cache_entry *ce;
+
+	while ((ce = TAILQ_FIRST(&c->lru)) != NULL)
+		xdev_cache_entry_free(c, ce);
+
+	assert(c->num_entries == 0);
+}
+
+int
+xdev_cache_init(struct xdev_cache *c)
+{
+
+	assert(c != NULL);
+
+	memset(c, 0, sizeof(*c));
+
+	if (__predict_false(xdev_hash_init(&c->index, 0) == -1))
+		return -1;
+
+	if (__predict_false(pthread_mutex_init(&c->mutex, NULL) != 0)) {
+		xdev_hash_fini(&c->index);
+		return -1;
+	}
+
+	TAILQ_INIT(&c->lru);
+
+	return 0;
+}
+
+void
+xdev_cache_fini(struct xdev_cache *c)
+{
+
+	assert(c != NULL);
+
+	xdev_cache_flush(c);
+	xdev_hash_fini(&c->index);
+	pthread_mutex_destroy(&c->mutex);
+}
+
+int
+xdev_cache_setup(struct xdev_cache *c, size_t max_entries,
+	unsigned int ttl_ms)
+{
+
+	assert(c != NULL);
+
+	pthread_mutex_lock(&c->mutex);
+	xdev_cache_flush(c);
+	c->max_entries = max_entries;
+	c->ttl.tv_sec = ttl_ms / 1000;
+	c->ttl.tv_nsec = (ttl_ms % 1000) * 1000000L;
+	c->generation++;
+	pthread_mutex_unlock(&c->mutex);
+
+	return 0;
+}
+
+/*
+ * Returns true on a hit, with *xdp referenced or set to NULL (and errno
+ * set) for a cached negative result.  On a miss *genp receives the
+ * generation to pass back to xdev_cache_insert().
+ */
+bool
+xdev_cache_lookup(struct xdev_cache *c, const char *devname,
+	struct xdev_device **xdp, uint64_t *genp)
+{
+	struct xdev_cache_entry *ce;
+	struct timespec now;
+	int error;
+
+	assert(c != NULL);
+	assert(devname != NULL);
+	assert(xdp != NULL);
+	assert(genp != NULL);
+
+	pthread_mutex_lock(&c->mutex);
+	*genp = c->generation;
+
+	if (c->max_entries == 0)
+		goto miss;
+
+	ce = (struct xdev_cache_entry *)xdev_hash_get(&c->index, devname);
+	if (ce == NULL)
+		goto miss;
+
+	if (timespecisset(&c->ttl)) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespeccmp(&now, &ce->expires, >=)) {
+			xdev_cache_entry_free(c, ce);
+			goto miss;
+		}
+	}
+
+	if (ce != TAILQ_FIRST(&c->lru)) {
+		TAILQ_REMOVE(&c->lru, ce, lru);
+		TAILQ_INSERT_HEAD(&c->lru, ce, lru);
+	}
+
+	if (ce->device == NULL) {
+		error = ce->error;
+		pthread_mutex_unlock(&c->mutex);
+		*xdp = NULL;
+		errno = error;
+		return true;
+	}
+
+	*xdp = xdev_device_ref(ce->device);
+	pthread_mutex_unlock(&c->mutex);
+	return true;
+
+miss:
+	pthread_mutex_unlock(&c->mutex);
+	return false;
+}
+
+/*
+ * Record the result of a lookup that missed.  The result is dropped
+ * if an invalidation raced with the lookup, as it may be stale.
+ */
+void
+xdev_cache_insert(struct xdev_cache *c, const char *devname,
+	struct xdev_device *xd, int error, uint64_t gen)
+{
+	struct xdev_cache_entry *ce;
+
+	assert(c != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&c->mutex);
+	if (c->max_entries == 0 || gen != c->generation)
+		goto out;
+
+	ce = (struct xdev_cache_entry *)xdev_hash_get(&c->index, devname);
+	if (ce != NULL)
+		xdev_cache_entry_free(c, ce);
+
+	if (c->num_entries >= c->max_entries)
+		xdev_cache_entry_free(c, TAILQ_LAST(&c->lru, xdev_cache_lru));
+
+	ce = (struct xdev_cache_entry *)calloc(1, sizeof(*ce));
+	if (__predict_false(ce == NULL))
+		goto out;
+
+	ce->devname = strdup(devname);
+	if (__predict_false(ce->devname == NULL))
+		goto fail;
+
+	if (__predict_false(xdev_hash_put(&c->index, ce->devname, ce) == -1))
+		goto fail2;
+
+	if (xd != NULL)
+		ce->device = xdev_device_ref(xd);
+	ce->error = error;
+
+	if (timespecisset(&c->ttl)) {
+		clock_gettime(CLOCK_MONOTONIC, &ce->expires);
+		timespecadd(&ce->expires, &c->ttl, &ce->expires);
+	}
+
+	TAILQ_INSERT_HEAD(&c->lru, ce, lru);
+	c->num_entries++;
+
+out:
+	pthread_mutex_unlock(&c->mutex);
+	return;
+
+fail2:
+	free(ce->devname);
+fail:
+	free(ce);
+	pthread_mutex_unlock(&c->mutex);
+}
+
+void
+xdev_cache_invalidate(struct xdev_cache *c, const char *devname)
+{
+	struct xdev_cache_entry *ce;
+
+	assert(c != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&c->mutex);
+	c->generation++;
+	if (c->max_entries != 0) {
+		ce = (struct xdev_cache_entry *)xdev_hash_get(&c->index,
+			devname);
+		if (ce != NULL)
+			xdev_cache_entry_free(c, ce);
+	}
+	pthread_mutex_unlock(&c->mutex);
+}
@@ -0,0 +1,79 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_CACHE_H_
+#define _XDEV_CACHE_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "xdev.h"
+#include "xdev_hash.h"
+
+struct xdev_cache_entry {
+	TAILQ_ENTRY(xdev_cache_entry) lru;
+	char *devname;
+	struct xdev_device *device;	/* NULL: negative entry */
+	int error;			/* errno of a negative entry */
+	struct timespec expires;
+};
+TAILQ_HEAD(xdev_cache_lru, xdev_cache_entry);
+
+/*
+ * LRU cache of xdev_device_from_devname() results, keyed by devname.
+ * Disabled while max_entries is 0.
+ */
+struct xdev_cache {
+	pthread_mutex_t mutex;
+	struct xdev_hash index;
+	struct xdev_cache_lru lru;	/* most recently used first */
+	size_t num_entries;
+	size_t max_entries;
+	struct timespec ttl;		/* zero: never expire */
+	uint64_t generation;		/* bumped on every invalidation */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_cache_init(struct xdev_cache *);
+void xdev_cache_fini(struct xdev_cache *);
+int xdev_cache_setup(struct xdev_cache *, size_t, unsigned int);
+bool xdev_cache_lookup(struct xdev_cache *, const char *,
+	struct xdev_device **, uint64_t *);
+void xdev_cache_insert(struct xdev_cache *, const char *,
+	struct xdev_device *, int, uint64_t);
+void xdev_cache_invalidate(struct xdev_cache *, const char *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_CACHE_H_ */
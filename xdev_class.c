@@ -0,0 +1,123 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <prop/proplib.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_class.h"
+
+struct xdev_class {
+	const char *driver;
+	size_t driver_len;
+	const char *devclass;
+	const char *devsubclass;
+};
+
+#include "xdev_class_hash.h"
+
+/*
+ * Fallback for drivers missing from xdev_class.list: guess from well
+ * known properties attached by the kernel.  Only consulted on a miss.
+ */
+static const struct {
+	const char *property;
+	const char *devclass;
+	const char *devsubclass;
+} xdev_class_hints[] = {
+	{ "disk-info",		"disk",		XDEV_CLASS_UNKNOWN },
+	{ "mac-address",	"network",	XDEV_CLASS_UNKNOWN },
+	{ "linebytes",		"display",	"framebuffer" },
+};
+
+void
+xdev_class_lookup(const char *driver, size_t len, prop_dictionary_t dict,
+	const char **devclass, const char **devsubclass)
+{
+	const struct xdev_class *xc;
+	size_t i;
+	uint32_t idx;
+
+	assert(driver != NULL);
+	assert(devclass != NULL);
+	assert(devsubclass != NULL);
+
+	idx = xdev_class_hash(driver, len);
+	if (__predict_true(idx < __arraycount(xdev_classes))) {
+		xc = &xdev_classes[idx];
+		if (xc->driver_len == len &&
+		    memcmp(xc->driver, driver, len) == 0) {
+			*devclass = xc->devclass;
+			*devsubclass = xc->devsubclass;
+			return;
+		}
+	}
+
+	if (dict != NULL) {
+		for (i = 0; i < __arraycount(xdev_class_hints); i++) {
+			if (prop_dictionary_get(dict,
+			    xdev_class_hints[i].property) == NULL)
+				continue;
+			*devclass = xdev_class_hints[i].devclass;
+			*devsubclass = xdev_class_hints[i].devsubclass;
+			return;
+		}
+	}
+
+	*devclass = XDEV_CLASS_UNKNOWN;
+	*devsubclass = XDEV_CLASS_UNKNOWN;
+}
+
+/*
+ * Events carry only the device name, which is the driver name followed
+ * by the unit number.
+ */
+void
+xdev_class_lookup_devname(const char *devname, const char **devclass,
+	const char **devsubclass)
+{
+	size_t len;
+
+	assert(devname != NULL);
+
+	len = strlen(devname);
+	while (len > 0 && isdigit((unsigned char)devname[len - 1]))
+		len--;
+
+	xdev_class_lookup(devname, len, NULL, devclass, devsubclass);
+}
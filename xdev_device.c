@@ -32,6 +32,7 @@
 __RCSID("$NetBSD$");
 
 #include <sys/types.h>
+#include <sys/atomic.h>
 #include <sys/drvctlio.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -39,21 +40,153 @@ __RCSID("$NetBSD$");
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_arena.h"
+#include "xdev_cache.h"
+#include "xdev_class.h"
 #include "xdev_device.h"
+#include "xdev_devnode.h"
+#include "xdev_inline.h"
+#include "xdev_intern.h"
 #include "xdev_list.h"
+#include "xdev_major.h"
+#include "xdev_pool.h"
 #include "xdev_private.h"
+#include "xdev_property.h"
 #include "xdev_utils.h"
 
+#define XDEV_HEAD_CTASSERT(f, h) \
+	__CTASSERT(offsetof(struct xdev_device, f) == \
+	    offsetof(struct xdev_device_head, h))
+
+/* xdev_inline.h reads devices through its own copy of the layout. */
+__CTASSERT(XDEV_DEVICE_MAGIC == XDEV_DEVICE_INLINE_MAGIC);
+XDEV_HEAD_CTASSERT(magic, xdh_magic);
+XDEV_HEAD_CTASSERT(devname, xdh_devname);
+XDEV_HEAD_CTASSERT(driver, xdh_driver);
+XDEV_HEAD_CTASSERT(devclass, xdh_devclass);
+XDEV_HEAD_CTASSERT(devsubclass, xdh_devsubclass);
+XDEV_HEAD_CTASSERT(event, xdh_event);
+XDEV_HEAD_CTASSERT(parent, xdh_parent);
+XDEV_HEAD_CTASSERT(unit, xdh_unit);
+
+static struct xdev_device *
+xdev_device_alloc(struct xdev_pool *xp, struct xdev_arena *xa)
+{
+	struct xdev_device *xd;
+
+	if (xp != NULL)
+		return xdev_pool_get_device(xp);
+
+	if (xa != NULL) {
+		xd = (struct xdev_device *)xdev_arena_alloc(xa, sizeof(*xd));
+		if (__predict_true(xd != NULL))
+			xd->flags = XDEV_DEVICE_ARENA;
+		return xd;
+	}
+
+	return (struct xdev_device *)calloc(sizeof(struct xdev_device), 1);
+}
+
+static void
+xdev_device_free(struct xdev_device *xd)
+{
+
+	if (xd->pool != NULL) {
+		if (xd->devname != xd->name)
+			free(__UNCONST(xd->devname));
+		xd->refcnt = 0;
+		xdev_pool_put_device(xd->pool, xd);
+		return;
+	}
+
+	xd->magic = 0xdeadbeef;
+	/* Arena memory goes with the arena, or with its last device. */
+	if ((xd->flags & XDEV_DEVICE_ARENA) == 0) {
+		if (xd->devname != xd->name)
+			free(__UNCONST(xd->devname));
+		free(xd);
+	} else if (xd->hold != NULL)
+		xdev_arena_hold_unref(xd->hold);
+}
+
+static void
+xdev_device_destroy(struct xdev_device *xd)
+{
+
+	if (xd->flags & XDEV_DEVICE_NOCOPY)
+		prop_object_release(xd->dict);
+	if (xd->backing != NULL)
+		xdev_device_unref(xd->backing);
+	free(xd->xml);
+	if (xd->props != NULL)
+		xdev_property_table_free(xd->props);
+	xdev_device_free(xd);
+}
+
+/* Names of the kernel fit in name[], longer ones are allocated. */
+static int
+xdev_device_set_devname(struct xdev_device *xd, struct xdev_arena *xa,
+	const char *devname)
+{
+	size_t len;
+	char *p;
+
+	len = strlen(devname) + 1;
+	if (__predict_true(len <= sizeof(xd->name)))
+		p = xd->name;
+	else if (xa != NULL)
+		p = (char *)xdev_arena_alloc(xa, len);
+	else
+		p = (char *)malloc(len);
+	if (__predict_false(p == NULL))
+		return -1;
+
+	memcpy(p, devname, len);
+	xd->devname = p;
+
+	return 0;
+}
+
+static int
+xdev_device_set_names(struct xdev_device *xd, struct xdev_arena *xa,
+	const char *devname, const char *driver, const char *devclass,
+	const char *devsubclass, const char *event, const char *parent)
+{
+	struct xdev_intern *xi;
+
+	if (__predict_false(xdev_device_set_devname(xd, xa, devname) == -1))
+		return -1;
+
+	xi = &xd->xdev->intern;
+
+	xd->driver = xdev_intern_string(xi, driver);
+	xd->devclass = xdev_intern_string(xi, devclass);
+	xd->devsubclass = xdev_intern_string(xi, devsubclass);
+	xd->event = xdev_intern_string(xi, event);
+	xd->parent = xdev_intern_string(xi, parent);
+
+	if (__predict_false(xd->driver == NULL || xd->devclass == NULL ||
+	    xd->devsubclass == NULL || xd->event == NULL ||
+	    xd->parent == NULL))
+		return -1;
+
+	return 0;
+}
+
 struct xdev_device *
-xdev_device_new(struct xdev *x, const char *devname, const char *driver,
-	const char *devclass, const char *devsubclass, const char *event,
-	const char *parent, const char *xml, uint32_t unit)
+xdev_device_new(struct xdev *x, struct xdev_pool *xp, const char *devname,
+	const char *driver, const char *devclass, const char *devsubclass,
+	const char *event, const char *parent, const char *xml, uint32_t unit,
+	prop_dictionary_t dict)
 {
 	struct xdev_device *xd;
 
@@ -66,8 +199,9 @@ xdev_device_new(struct xdev *x, const char *devname, const char *driver,
 	assert(event != NULL);
 	assert(parent != NULL);
 	assert(xml != NULL);
+	assert(dict != NULL);
 
-	xd = (struct xdev_device *)calloc(sizeof(*xd), 1);
+	xd = xdev_device_alloc(xp, NULL);
 	if (__predict_false(xd == NULL))
 		return NULL;
 
@@ -75,54 +209,160 @@ xdev_device_new(struct xdev *x, const char *devname, const char *driver,
 	xd->magic = XDEV_DEVICE_MAGIC;
 	xd->xdev = x;
 
-	xd->devname = strdup(devname);
-	if (__predict_false(xd->devname == NULL))
+	if (__predict_false(xdev_device_set_names(xd, NULL, devname, driver,
+	    devclass, devsubclass, event, parent) == -1))
 		goto fail1;
 
-	xd->driver = strdup(driver);
-	if (__predict_false(xd->driver == NULL))
+	xd->xml = strdup(xml);
+	if (__predict_false(xd->xml == NULL))
+		goto fail1;
+
+	xd->unit = unit;
+
+	xd->props = xdev_property_table_new(dict);
+	if (__predict_false(xd->props == NULL))
 		goto fail2;
 
-	xd->devclass = strdup(devclass);
-	if (__predict_false(xd->devclass == NULL))
-		goto fail3;
+	return xd;
 
-	xd->devsubclass = strdup(devsubclass);
-	if (__predict_false(xd->devsubclass == NULL))
-		goto fail4;
+fail2:
+	free(xd->xml);
+fail1:
+	xdev_device_free(xd);
 
-	xd->event = strdup(event);
-	if (__predict_false(xd->event == NULL))
-		goto fail5;
+	return NULL;
+}
 
-	xd->parent = strdup(parent);
-	if (__predict_false(xd->parent == NULL))
-		goto fail6;
+/*
+ * Create a device that keeps the dictionary it was built from.  The
+ * XML and the property table are only generated on first use.
+ */
+static struct xdev_device *
+xdev_device_new_nocopy_in(struct xdev *x, struct xdev_pool *xp,
+	struct xdev_arena *xa, prop_dictionary_t dict, const char *devname,
+	const char *driver, const char *devclass, const char *devsubclass,
+	const char *event, const char *parent, uint32_t unit)
+{
+	struct xdev_device *xd;
 
-	xd->xml = strdup(xml);
-	if (__predict_false(xd->xml == NULL))
-		goto fail7;
+	assert(x != NULL);
+	assert(x->magic == XDEV_MAGIC);
+	assert(dict != NULL);
+	assert(devname != NULL);
+	assert(driver != NULL);
+	assert(devclass != NULL);
+	assert(devsubclass != NULL);
+	assert(event != NULL);
+	assert(parent != NULL);
 
+	xd = xdev_device_alloc(xp, xa);
+	if (__predict_false(xd == NULL))
+		return NULL;
+
+	xd->refcnt = 1;
+	xd->magic = XDEV_DEVICE_MAGIC;
+	xd->xdev = x;
+	xd->flags |= XDEV_DEVICE_NOCOPY;
+
+	if (__predict_false(xdev_device_set_names(xd, xa, devname, driver,
+	    devclass, devsubclass, event, parent) == -1)) {
+		xdev_device_free(xd);
+		return NULL;
+	}
+
+	prop_object_retain(dict);
+	xd->dict = dict;
 	xd->unit = unit;
 
 	return xd;
+}
 
-fail7:
-	free(xd->parent);
-fail6:
-	free(xd->event);
-fail5:
-	free(xd->devsubclass);
-fail4:
-	free(xd->devclass);
-fail3:
-	free(xd->driver);
-fail2:
-	free(xd->devname);
-fail1:
-	free(xd);
+struct xdev_device *
+xdev_device_new_nocopy(struct xdev *x, struct xdev_pool *xp,
+	prop_dictionary_t dict, const char *devname, const char *driver,
+	const char *devclass, const char *devsubclass, const char *event,
+	const char *parent, uint32_t unit)
+{
 
-	return NULL;
+	return xdev_device_new_nocopy_in(x, xp, NULL, dict, devname, driver,
+		devclass, devsubclass, event, parent, unit);
+}
+
+/*
+ * Create a device that only knows its name and parent, in xa if not
+ * NULL.  Everything else is fetched from drvctl(4) when first asked
+ * for, see xdev_device_materialize().
+ */
+struct xdev_device *
+xdev_device_new_lazy(struct xdev *x, struct xdev_arena *xa,
+	const char *devname, const char *parent)
+{
+	struct xdev_device *xd;
+	struct xdev_intern *xi;
+
+	assert(x != NULL);
+	assert(x->magic == XDEV_MAGIC);
+	assert(devname != NULL);
+	assert(parent != NULL);
+
+	xd = xdev_device_alloc(NULL, xa);
+	if (__predict_false(xd == NULL))
+		return NULL;
+
+	xd->refcnt = 1;
+	xd->magic = XDEV_DEVICE_MAGIC;
+	xd->xdev = x;
+	xd->flags |= XDEV_DEVICE_LAZY;
+
+	if (__predict_false(xdev_device_set_devname(xd, xa, devname) == -1)) {
+		xdev_device_free(xd);
+		return NULL;
+	}
+
+	xi = &x->intern;
+	xd->event = xdev_intern_string(xi, "device-attach");
+	xd->parent = xdev_intern_string(xi, parent);
+	if (__predict_false(xd->event == NULL || xd->parent == NULL)) {
+		xdev_device_free(xd);
+		return NULL;
+	}
+
+	return xd;
+}
+
+/*
+ * Return the device holding the properties of xd: xd itself, or for a
+ * lazy device the one fetched for it on first use.
+ */
+static struct xdev_device *
+xdev_device_materialize(struct xdev_device *xd)
+{
+	struct xdev_device *backing;
+	prop_dictionary_t c;
+	int error;
+
+	if (__predict_true((xd->flags & XDEV_DEVICE_LAZY) == 0))
+		return xd;
+
+	if (xd->backing != NULL)
+		return xd->backing;
+
+	c = NULL;
+	backing = xdev_device_lookup(xd->xdev, &c, xd->devname);
+	if (c != NULL) {
+		error = errno;
+		prop_object_release(c);
+		errno = error;
+	}
+	if (__predict_false(backing == NULL))
+		return NULL;
+
+	/* Publish it, unless a concurrent caller did so first. */
+	membar_producer();
+	if (atomic_cas_ptr(&xd->backing, NULL, backing) != NULL)
+		xdev_device_unref(backing);
+
+	return xd->backing;
 }
 
 struct xdev_device *
@@ -193,23 +433,215 @@ fail:
 	return NULL;
 }
 
-struct xdev_device *
-xdev_device_from_devname(struct xdev *x, const char *devname)
+/*
+ * Build a get-properties request.  The device-name argument is filled
+ * in by xdev_device_fetch(), so one request can serve many lookups.
+ */
+prop_dictionary_t
+xdev_device_command_new(void)
+{
+	prop_dictionary_t c, a;
+	bool b;
+
+	c = prop_dictionary_create();
+	if (__predict_false(c == NULL)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	a = prop_dictionary_create();
+	if (__predict_false(a == NULL)) {
+		prop_object_release(c);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	b = prop_dictionary_set_cstring_nocopy(c, "drvctl-command",
+		"get-properties");
+	b = b && prop_dictionary_set(c, "drvctl-arguments", a);
+	prop_object_release(a);
+	if (__predict_false(b == false)) {
+		prop_object_release(c);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return c;
+}
+
+/*
+ * Fetch the properties of devname.  With an arena the device is put
+ * there, keeping the reply instead of converting it to XML, which is
+ * only done if asked for.  Fails with ENODEV only if the kernel has no
+ * such device; a failed request keeps its errno and a malformed reply
+ * gives EIO.
+ */
+static struct xdev_device *
+xdev_device_fetch_in(struct xdev *x, struct xdev_arena *xa, prop_dictionary_t c,
+	const char *devname)
 {
 	struct xdev_device *xd;
-	prop_string_t s;
-	prop_dictionary_t c, a, d;
+	prop_dictionary_t a, d;
 	prop_dictionary_t result_data;
 	int r;
 	int8_t perr;
 	bool b;
 
-	char *driver;
-	char *parent;
+	const char *driver;
+	const char *parent;
 	uint32_t unit;
+	const char *devclass;
+	const char *devsubclass;
 
 	char *xml;
 
+	assert(x != NULL);
+	assert(c != NULL);
+	assert(devname != NULL);
+
+	a = prop_dictionary_get(c, "drvctl-arguments");
+	assert(a != NULL);
+
+	if (__predict_false(
+	    !prop_dictionary_set_cstring(a, "device-name", devname))) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	r = prop_dictionary_sendrecv_ioctl(c, x->drvctl_fd, DRVCTLCOMMAND, &d);
+	if (__predict_false(r != 0)) {
+		errno = r;
+		return NULL;
+	}
+
+	b = prop_dictionary_get_int8(d, "drvctl-error", &perr);
+	if (__predict_false(b == false)) {
+		prop_object_release(d);
+		errno = EIO;
+		return NULL;
+	}
+	if (__predict_false(perr != 0)) {
+		prop_object_release(d);
+		/* The kernel answers ESRCH for a name it does not know. */
+		if (perr == ESRCH || perr == ENXIO || perr == ENODEV)
+			errno = ENODEV;
+		else
+			errno = perr;
+		return NULL;
+	}
+
+	result_data = prop_dictionary_get(d, "drvctl-result-data");
+	if (__predict_false(result_data == false)) {
+		prop_object_release(d);
+		errno = EIO;
+		return NULL;
+	}
+
+	b = prop_dictionary_get_cstring_nocopy(result_data, "device-driver",
+		&driver);
+	if (__predict_false(b == false)) {
+		prop_object_release(d);
+		errno = EIO;
+		return NULL;
+	}
+
+	b = prop_dictionary_get_cstring_nocopy(result_data, "device-parent",
+		&parent);
+	if (__predict_false(b == false)) {
+		/* If missing, the node is a top-level entry in the tree. */
+		parent = "";
+	}
+
+	b = prop_dictionary_get_uint32(result_data, "device-unit", &unit);
+	if (__predict_false(b == false)) {
+		prop_object_release(d);
+		errno = EIO;
+		return NULL;
+	}
+
+	xdev_class_lookup(driver, strlen(driver), result_data, &devclass,
+		&devsubclass);
+
+	if (xa != NULL) {
+		xd = xdev_device_new_nocopy_in(x, NULL, xa, result_data,
+			devname, driver, devclass, devsubclass, "device-attach",
+			parent, unit);
+		prop_object_release(d);
+		return xd;
+	}
+
+	xml = prop_dictionary_externalize(result_data);
+	if (__predict_false(xml == NULL)) {
+		prop_object_release(d);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	xd = xdev_device_new(x, NULL, devname, driver, devclass, devsubclass,
+		"device-attach", parent, xml, unit, result_data);
+	free(xml);
+	prop_object_release(d);
+	return xd;
+}
+
+struct xdev_device *
+xdev_device_fetch(struct xdev *x, prop_dictionary_t c, const char *devname)
+{
+
+	return xdev_device_fetch_in(x, NULL, c, devname);
+}
+
+struct xdev_device *
+xdev_device_fetch_arena(struct xdev *x, struct xdev_arena *xa,
+	prop_dictionary_t c, const char *devname)
+{
+
+	assert(xa != NULL);
+
+	return xdev_device_fetch_in(x, xa, c, devname);
+}
+
+/*
+ * Cached lookup.  *cp holds the get-properties request to use; it is
+ * created on the first cache miss and left for the caller to release.
+ * Only a device the kernel does not have is cached as missing, other
+ * failures are retried on the next lookup.
+ */
+struct xdev_device *
+xdev_device_lookup(struct xdev *x, prop_dictionary_t *cp, const char *devname)
+{
+	struct xdev_device *xd;
+	uint64_t gen;
+
+	assert(x != NULL);
+	assert(cp != NULL);
+	assert(devname != NULL);
+
+	if (xdev_cache_lookup(&x->cache, devname, &xd, &gen))
+		return xd;
+
+	if (*cp == NULL) {
+		*cp = xdev_device_command_new();
+		if (__predict_false(*cp == NULL))
+			return NULL;
+	}
+
+	xd = xdev_device_fetch(x, *cp, devname);
+	if (xd != NULL)
+		xdev_cache_insert(&x->cache, devname, xd, 0, gen);
+	else if (errno == ENODEV)
+		xdev_cache_insert(&x->cache, devname, NULL, ENODEV, gen);
+
+	return xd;
+}
+
+struct xdev_device *
+xdev_device_from_devname(struct xdev *x, const char *devname)
+{
+	struct xdev_device *xd;
+	prop_dictionary_t c;
+	int error;
+
 	if (__predict_false(x == NULL)) {
 		errno = EINVAL;
 		return NULL;
@@ -225,72 +657,134 @@ xdev_device_from_devname(struct xdev *x, const char *devname)
 		return NULL;
 	}
 
-	c = prop_dictionary_create();
-	a = prop_dictionary_create();
+	c = NULL;
+	xd = xdev_device_lookup(x, &c, devname);
+	if (c != NULL) {
+		error = errno;
+		prop_object_release(c);
+		errno = error;
+	}
 
-	s = prop_string_create_cstring_nocopy("get-properties");
-	prop_dictionary_set(c, "drvctl-command", s);
-	prop_object_release(s);
+	return xd;
+}
 
-	s = prop_string_create_cstring(devname);
-	prop_dictionary_set(a, "device-name", s);
-	prop_object_release(s);
+/*
+ * The device a special file in /dev belongs to, from the index of /dev
+ * kept in x.  Only the first lookup scans the directory.
+ */
+struct xdev_device *
+xdev_device_from_devnode(struct xdev *x, const char *path)
+{
+	char devname[XDEV_DEVICE_NAME_SIZE];
 
-	prop_dictionary_set(c, "drvctl-arguments", a);
-	prop_object_release(a);
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
 
-	r = prop_dictionary_sendrecv_ioctl(c, x->drvctl_fd, DRVCTLCOMMAND, &d);
-	prop_object_release(c);
-	if (__predict_false(r != 0)) {
-		errno = ENODEV;
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
 		return NULL;
 	}
 
-	b = prop_dictionary_get_int8(d, "drvctl-error", &perr);
-	if (__predict_false(b == false || perr != 0)) {
-		prop_object_release(d);
-		errno = ENODEV;
+	if (__predict_false(path == NULL)) {
+		errno = EINVAL;
 		return NULL;
 	}
 
-	result_data = prop_dictionary_get(d, "drvctl-result-data");
-	if (__predict_false(result_data == false)) {
-		prop_object_release(d);
-		errno = ENODEV;
+	if (__predict_false(xdev_devnodes_lookup_path(&x->devnodes, path,
+	    devname, sizeof(devname)) == -1))
+		return NULL;
+
+	return xdev_device_from_devname(x, devname);
+}
+
+struct xdev_device *
+xdev_device_from_devt(struct xdev *x, mode_t type, dev_t dev)
+{
+	char devname[XDEV_DEVICE_NAME_SIZE];
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(type != S_IFCHR && type != S_IFBLK)) {
+		errno = EINVAL;
 		return NULL;
 	}
 
-	b = prop_dictionary_get_cstring(result_data, "device-driver", &driver);
-	if (__predict_false(b == false)) {
-		prop_object_release(d);
-		errno = ENODEV;
-		return NULL;
+	if (__predict_false(xdev_devnodes_lookup_dev(&x->devnodes, type, dev,
+	    devname, sizeof(devname)) == -1))
+		return NULL;
+
+	return xdev_device_from_devname(x, devname);
+}
+
+/*
+ * Resolve n devnames at once, sharing a single get-properties request
+ * between the lookups that miss the cache.  out[i] receives the device
+ * or NULL, errors[i] (if errors is not NULL) 0 or the errno of the
+ * failed lookup.  Returns the number of devices resolved.
+ */
+int
+xdev_devices_from_devnames(struct xdev *x, const char * const *names,
+	size_t n, struct xdev_device **out, int *errors)
+{
+	struct xdev_device *xd;
+	prop_dictionary_t c;
+	size_t i;
+	int found;
+	int error;
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	b = prop_dictionary_get_cstring(result_data, "device-parent", &parent);
-	if (__predict_false(b == false)) {
-		/* If missing, the node is a top-level entry in the tree. */
-		parent = "";
+	if (__predict_false(n > INT_MAX)) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	b = prop_dictionary_get_uint32(result_data, "device-unit", &unit);
-	if (__predict_false(b == false)) {
-		prop_object_release(d);
-		errno = ENODEV;
-		return NULL;
+	if (__predict_false(n > 0 && (names == NULL || out == NULL))) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	xml = prop_dictionary_externalize(result_data);
-	if (__predict_false(xml == NULL)) {
-		prop_object_release(d);
-		errno = ENODEV;
-		return NULL;
+	c = NULL;
+	found = 0;
+
+	for (i = 0; i < n; i++) {
+		if (__predict_false(names[i] == NULL)) {
+			xd = NULL;
+			error = EINVAL;
+		} else {
+			xd = xdev_device_lookup(x, &c, names[i]);
+			error = xd == NULL ? errno : 0;
+		}
+
+		out[i] = xd;
+		if (errors != NULL)
+			errors[i] = error;
+		if (xd != NULL)
+			found++;
 	}
 
-	xd = xdev_device_new(x, devname, driver, "???", "???", "device-attach", parent, xml, unit);
-	free(xml);
-	prop_object_release(d);
-	return xd;
+	if (c != NULL)
+		prop_object_release(c);
+
+	return found;
 }
 
 struct xdev_device *
@@ -307,15 +801,14 @@ xdev_device_ref(struct xdev_device *xd)
 		return NULL;
 	}
 
-	xd->refcnt++;
+	atomic_inc_uint(&xd->refcnt);
 
 	assert(xd->devname != NULL);
-	assert(xd->driver != NULL);
-	assert(xd->devclass != NULL);
-	assert(xd->devsubclass != NULL);
 	assert(xd->event != NULL);
 	assert(xd->parent != NULL);
-	assert(xd->xml != NULL);
+	assert((xd->flags & XDEV_DEVICE_LAZY) != 0 || (xd->driver != NULL &&
+	    xd->devclass != NULL && xd->devsubclass != NULL &&
+	    (xd->xml != NULL || xd->dict != NULL)));
 
 	return xd;
 }
@@ -335,31 +828,66 @@ xdev_device_unref(struct xdev_device *xd)
 	}
 
 	assert(xd->devname != NULL);
-	assert(xd->driver != NULL);
-	assert(xd->devclass != NULL);
-	assert(xd->devsubclass != NULL);
 	assert(xd->event != NULL);
 	assert(xd->parent != NULL);
-	assert(xd->xml != NULL);
-
-	if (xd->refcnt == 1) {
-		free(xd->devname);
-		free(xd->driver);
-		free(xd->devclass);
-		free(xd->devsubclass);
-		free(xd->event);
-		free(xd->parent);
-		free(xd->xml);
-		xd->magic = 0xdeadbeef;
-		free(xd);
+	assert((xd->flags & XDEV_DEVICE_LAZY) != 0 || (xd->driver != NULL &&
+	    xd->devclass != NULL && xd->devsubclass != NULL &&
+	    (xd->xml != NULL || xd->dict != NULL)));
+
+	membar_exit();
+	if (atomic_dec_uint_nv(&xd->refcnt) == 0) {
+		membar_enter();
+		xdev_device_destroy(xd);
 		return NULL;
 	}
 
-	xd->refcnt--;
-
 	return xd;
 }
 
+/*
+ * A device of one's own for one that may live in an enumeration's
+ * arena, which is valid beyond the next scan.  Others are shared.
+ */
+struct xdev_device *
+xdev_device_copy(struct xdev_device *xd)
+{
+	struct xdev_device *md, *copy;
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((xd->flags & XDEV_DEVICE_ARENA) == 0)
+		return xdev_device_ref(xd);
+
+	/* The fetched properties of a lazy device are not in the arena. */
+	md = xdev_device_materialize(xd);
+	if (__predict_false(md == NULL))
+		return NULL;
+	if (md != xd)
+		return xdev_device_ref(md);
+
+	copy = xdev_device_new_nocopy(xd->xdev, NULL, xd->dict, xd->devname,
+		xd->driver, xd->devclass, xd->devsubclass, xd->event,
+		xd->parent, xd->unit);
+	if (__predict_false(copy == NULL))
+		return NULL;
+
+	copy->seq = xd->seq;
+	if (xd->has_fingerprint) {
+		copy->fingerprint = xd->fingerprint;
+		copy->has_fingerprint = 1;
+	}
+
+	return copy;
+}
+
 struct xdev *
 xdev_device_get_xdev(struct xdev_device *xd)
 {
@@ -414,6 +942,10 @@ xdev_device_get_driver(struct xdev_device *xd, const char **driver)
 		return -1;
 	}
 
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
 	assert(xd->driver != NULL);
 
 	if (driver != NULL)
@@ -435,6 +967,10 @@ xdev_device_get_devclass(struct xdev_device *xd, const char **devclass)
 		return -1;
 	}
 
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
 	assert(xd->devclass != NULL);
 
 	if (devclass != NULL)
@@ -456,6 +992,10 @@ xdev_device_get_devsubclass(struct xdev_device *xd, const char **devsubclass)
 		return -1;
 	}
 
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
 	assert(xd->devsubclass != NULL);
 
 	if (devsubclass != NULL)
@@ -517,11 +1057,74 @@ xdev_device_get_unit(struct xdev_device *xd, uint32_t *unit)
 		return -1;
 	}
 
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
 	if (unit != NULL)
 		*unit = xd->unit;
 	return 0;
 }
 
+/*
+ * The sequence number of the event the device was created for, 0 for
+ * devices that do not come from a monitor.
+ */
+int
+xdev_device_get_seqnum(struct xdev_device *xd, uint64_t *seq)
+{
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (seq != NULL)
+		*seq = xd->seq;
+	return 0;
+}
+
+/*
+ * When the monitor read, queued and handed out the event the device was
+ * created for, on CLOCK_MONOTONIC.  Fails with ENOENT for stamps not
+ * taken, see xdev_monitor_set_timestamps().
+ */
+int
+xdev_device_get_timestamp(struct xdev_device *xd, int stage,
+	struct timespec *ts)
+{
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(stage < 0 ||
+	    stage >= (int)__arraycount(xd->stamps))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (xd->stamps[stage].tv_sec == 0 && xd->stamps[stage].tv_nsec == 0) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (ts != NULL)
+		*ts = xd->stamps[stage];
+	return 0;
+}
+
 int
 xdev_device_get_major(struct xdev_device *xd, mode_t type, devmajor_t *devmajor)
 {
@@ -536,14 +1139,105 @@ xdev_device_get_major(struct xdev_device *xd, mode_t type, devmajor_t *devmajor)
 		return -1;
 	}
 
-	if (devmajor != NULL)
-		*devmajor = getdevmajor(xd->driver, type);
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	if (devmajor == NULL)
+		return 0;
+
+	switch (type) {
+	case S_IFCHR:
+		return xdev_majors_lookup(&xd->xdev->majors, xd->driver,
+			devmajor, NULL);
+	case S_IFBLK:
+		return xdev_majors_lookup(&xd->xdev->majors, xd->driver,
+			NULL, devmajor);
+	default:
+		*devmajor = NODEVMAJOR;
+		return 0;
+	}
+}
+
+/*
+ * Whether xd is root or lies below it in the device tree, "" being the
+ * root of the whole tree.  Answered from the xdev's parent map, so
+ * without drvctl(4) requests once the map is built.  Returns 1 if so, 0
+ * if not.
+ */
+int
+xdev_device_is_below(struct xdev_device *xd, const char *root)
+{
+
+	if (__predict_false(xd == NULL || root == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_ancestry_is_below(&xd->xdev->ancestry, xd->devname,
+		xd->parent, root);
+}
+
+/*
+ * Everything the single-field getters return, with one validation and
+ * at most one fetch for a lazy device.  The lengths spare callers a
+ * strlen(3) of their own.
+ */
+int
+xdev_device_get_info(struct xdev_device *xd, struct xdev_device_info *xdi)
+{
+	struct xdev_device *md;
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xdi == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	md = xdev_device_materialize(xd);
+	if (__predict_false(md == NULL))
+		return -1;
+
+	if (__predict_false(xdev_majors_lookup(&md->xdev->majors, md->driver,
+	    &xdi->xdi_cmajor, &xdi->xdi_bmajor) == -1))
+		return -1;
+
+	/* A lazy device keeps its own event and parent. */
+	xdi->xdi_devname = xd->devname;
+	xdi->xdi_driver = md->driver;
+	xdi->xdi_devclass = md->devclass;
+	xdi->xdi_devsubclass = md->devsubclass;
+	xdi->xdi_event = xd->event;
+	xdi->xdi_parent = xd->parent;
+	xdi->xdi_devname_len = strlen(xd->devname);
+	xdi->xdi_driver_len = strlen(md->driver);
+	xdi->xdi_devclass_len = strlen(md->devclass);
+	xdi->xdi_devsubclass_len = strlen(md->devsubclass);
+	xdi->xdi_event_len = strlen(xd->event);
+	xdi->xdi_parent_len = strlen(xd->parent);
+	xdi->xdi_unit = md->unit;
+
 	return 0;
 }
 
 int
 xdev_device_externalize(struct xdev_device *xd, const char **xml)
 {
+	char *buf;
 
 	if (__predict_false(xd == NULL)) {
 		errno = EINVAL;
@@ -555,9 +1249,184 @@ xdev_device_externalize(struct xdev_device *xd, const char **xml)
 		return -1;
 	}
 
-	assert(xd->xml != NULL);
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	if (xd->xml == NULL) {
+		assert(xd->dict != NULL);
+		buf = prop_dictionary_externalize(xd->dict);
+		if (__predict_false(buf == NULL)) {
+			errno = ENOMEM;
+			return -1;
+		}
+		/* Publish it, unless a concurrent caller did so first. */
+		membar_producer();
+		if (atomic_cas_ptr(&xd->xml, NULL, buf) != NULL)
+			free(buf);
+	}
 
 	if (xml != NULL)
 		*xml = xd->xml;
 	return 0;
 }
+
+/*
+ * Store up to max paths of the device's special files in /dev, block
+ * and character, whole disk and partitions, in paths.  The paths are
+ * copies for the caller to free(3), the nodes come and go with hotplug.
+ * Returns how many there are, which may be more than max.
+ */
+ssize_t
+xdev_device_get_devnodes(struct xdev_device *xd, char **paths, size_t max)
+{
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(paths == NULL && max > 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_devnodes_get(&xd->xdev->devnodes, xd->devname, paths, max);
+}
+
+/*
+ * A 64-bit hash of the device's properties, as externalized, so that
+ * two devices can be told apart without comparing their XML.
+ */
+int
+xdev_device_get_fingerprint(struct xdev_device *xd, uint64_t *fingerprint)
+{
+	const char *xml;
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	if (!xd->has_fingerprint) {
+		if (__predict_false(xdev_device_externalize(xd, &xml) == -1))
+			return -1;
+		/* Concurrent callers store the same value. */
+		xd->fingerprint = xstrhash64(xml);
+		membar_producer();
+		xd->has_fingerprint = 1;
+	} else
+		membar_consumer();
+
+	if (fingerprint != NULL)
+		*fingerprint = xd->fingerprint;
+	return 0;
+}
+
+static const struct xdev_property *
+xdev_device_get_property(struct xdev_device *xd, const char *key, int type)
+{
+	struct xdev_property_table *xpt;
+	const struct xdev_property *xp;
+
+	if (__predict_false(xd == NULL || key == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	xd = xdev_device_materialize(xd);
+	if (__predict_false(xd == NULL))
+		return NULL;
+
+	if (xd->props == NULL) {
+		assert(xd->dict != NULL);
+		xpt = xdev_property_table_new(xd->dict);
+		if (__predict_false(xpt == NULL))
+			return NULL;
+		membar_producer();
+		if (atomic_cas_ptr(&xd->props, NULL, xpt) != NULL)
+			xdev_property_table_free(xpt);
+	}
+
+	xp = xdev_property_table_lookup(xd->props, key);
+	if (xp == NULL) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	if (__predict_false(xp->type != type)) {
+		errno = EFTYPE;
+		return NULL;
+	}
+
+	return xp;
+}
+
+int
+xdev_device_get_property_string(struct xdev_device *xd, const char *key,
+	const char **value)
+{
+	const struct xdev_property *xp;
+
+	xp = xdev_device_get_property(xd, key, XDEV_PROPERTY_STRING);
+	if (xp == NULL)
+		return -1;
+
+	if (value != NULL)
+		*value = xp->value.s;
+	return 0;
+}
+
+int
+xdev_device_get_property_uint(struct xdev_device *xd, const char *key,
+	uint64_t *value)
+{
+	const struct xdev_property *xp;
+
+	xp = xdev_device_get_property(xd, key, XDEV_PROPERTY_NUMBER);
+	if (xp == NULL)
+		return -1;
+
+	if (__predict_false(xp->negative)) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	if (value != NULL)
+		*value = xp->value.u;
+	return 0;
+}
+
+int
+xdev_device_get_property_bool(struct xdev_device *xd, const char *key,
+	bool *value)
+{
+	const struct xdev_property *xp;
+
+	xp = xdev_device_get_property(xd, key, XDEV_PROPERTY_BOOL);
+	if (xp == NULL)
+		return -1;
+
+	if (value != NULL)
+		*value = xp->value.b;
+	return 0;
+}
@@ -33,30 +33,80 @@
 
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <sys/queue.h>
+
+#include <prop/proplib.h>
+#include <time.h>
 
 #include "xdev.h"
 #include "xdev_list.h"
+#include "xdev_property.h"
 
 #define XDEV_DEVICE_MAGIC 0x8639fbc2
 
+struct xdev_arena;
+struct xdev_arena_hold;
+struct xdev_pool;
+
+/* flags */
+#define XDEV_DEVICE_NOCOPY	0x1	/* dict retained, xml built lazily */
+#define XDEV_DEVICE_LAZY	0x2	/* names only, rest in backing */
+#define XDEV_DEVICE_ARENA	0x4	/* in an enumeration's arena */
+
+/* Device names of the kernel fit, see DEVICE_XNAME_SIZE. */
+#define XDEV_DEVICE_NAME_SIZE	16
+
+/*
+ * Devices may be shared between threads (lookup cache, monitor thread),
+ * hence the atomic reference count.  They are immutable once created.
+ * The devname is the device's own, usually in name[].  The other name
+ * strings are interned in the xdev and not owned by the device.
+ * Only the receive stamp is set later, by the monitor's consumer.
+ */
 struct xdev_device {
-	int refcnt;
+	volatile unsigned int refcnt;
 	int magic;
 	struct xdev *xdev;
-	char *devname;
-	char *driver;
-	char *devclass;
-	char *devsubclass;
-	char *event;
-	char *parent;
+	const char *devname;
+	const char *driver;
+	const char *devclass;
+	const char *devsubclass;
+	const char *event;
+	const char *parent;
 	char *xml;
 	uint32_t unit;
+	int flags;
+	uint64_t seq;			/* monitor events only, else 0 */
+	struct timespec stamps[3];	/* XDEV_STAMP_*, see below */
+	uint64_t fingerprint;		/* valid once has_fingerprint */
+	volatile unsigned int has_fingerprint;
+	prop_dictionary_t dict;		/* retained by XDEV_DEVICE_NOCOPY */
+	struct xdev_property_table *props;
+	struct xdev_device *backing;	/* XDEV_DEVICE_LAZY, once fetched */
+	struct xdev_pool *pool;		/* recycled into, if not NULL */
+	struct xdev_arena_hold *hold;	/* XDEV_DEVICE_ARENA, if outliving */
+	SLIST_ENTRY(xdev_device) free_link;
+	char name[XDEV_DEVICE_NAME_SIZE];
 };
 
 __BEGIN_HIDDEN_DECLS
 struct xdev_device *
-xdev_device_new(struct xdev *, const char *, const char *, const char *,
-	const char *, const char *, const char *, const char *, uint32_t);
+xdev_device_new(struct xdev *, struct xdev_pool *, const char *, const char *,
+	const char *, const char *, const char *, const char *, const char *,
+	uint32_t, prop_dictionary_t);
+struct xdev_device *
+xdev_device_new_nocopy(struct xdev *, struct xdev_pool *, prop_dictionary_t,
+	const char *, const char *, const char *, const char *, const char *,
+	const char *, uint32_t);
+struct xdev_device *xdev_device_new_lazy(struct xdev *, struct xdev_arena *,
+	const char *, const char *);
+prop_dictionary_t xdev_device_command_new(void);
+struct xdev_device *xdev_device_fetch(struct xdev *, prop_dictionary_t,
+	const char *);
+struct xdev_device *xdev_device_fetch_arena(struct xdev *, struct xdev_arena *,
+	prop_dictionary_t, const char *);
+struct xdev_device *xdev_device_lookup(struct xdev *, prop_dictionary_t *,
+	const char *);
 __END_HIDDEN_DECLS
 
 #endif /* !_XDEV_DEVICE_H_ */
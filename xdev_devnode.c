@@ -0,0 +1,573 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/disklabel.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <paths.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_class.h"
+#include "xdev_devnode.h"
+#include "xdev_utils.h"
+
+static void
+xdev_devnode_key(char *key, size_t len, mode_t type, dev_t dev)
+{
+
+	snprintf(key, len, "%c%jx", S_ISCHR(type) ? 'c' : 'b', (uintmax_t)dev);
+}
+
+/*
+ * The unit a minor number stands for.  st(4) keeps the mode and density
+ * in the low four bits of the minor, fd(4) the density in the low three
+ * bits of its disk unit, and other disks with a disklabel the
+ * partition.  Wedges and everything else are a unit per minor.
+ */
+static uint32_t
+xdev_devnode_unit(const struct kinfo_drivers *kid, dev_t rdev)
+{
+	const char *devclass, *devsubclass;
+
+	if (strcmp(kid->d_name, "st") == 0)
+		return minor(rdev) >> 4;
+
+	if (strcmp(kid->d_name, "fd") == 0)
+		return DISKUNIT(rdev) / 8;
+
+	if (kid->d_bmajor == NODEVMAJOR)
+		return minor(rdev);
+
+	xdev_class_lookup(kid->d_name, strlen(kid->d_name), NULL, &devclass,
+		&devsubclass);
+	if (strcmp(devclass, "disk") == 0 && strcmp(devsubclass, "wedge") != 0)
+		return DISKUNIT(rdev);
+
+	return minor(rdev);
+}
+
+/*
+ * Name the device a special file belongs to after its major and minor
+ * numbers.
+ */
+static bool
+xdev_devnode_devname(const struct kinfo_drivers *kid, size_t cnt,
+	const struct stat *st, char *buf, size_t len)
+{
+	devmajor_t maj;
+	uint32_t unit;
+	size_t i;
+
+	maj = major(st->st_rdev);
+
+	for (i = 0; i < cnt; i++) {
+		if (S_ISCHR(st->st_mode) ? kid[i].d_cmajor == maj :
+		    kid[i].d_bmajor == maj)
+			break;
+	}
+	if (i == cnt)
+		return false;
+
+	unit = xdev_devnode_unit(&kid[i], st->st_rdev);
+
+	return snprintf(buf, len, "%s%" PRIu32, kid[i].d_name, unit) <
+	    (int)len;
+}
+
+static int
+xdev_devnodes_add(struct xdev_devnodes *dn, const char *path,
+	const char *devname, const struct stat *st)
+{
+	struct xdev_devnode *node;
+	size_t plen, nlen;
+
+	if (xdev_hash_get(&dn->bypath, path) != NULL)
+		return 0;
+
+	plen = strlen(path) + 1;
+	nlen = strlen(devname) + 1;
+	node = (struct xdev_devnode *)calloc(sizeof(*node) + plen + nlen, 1);
+	if (__predict_false(node == NULL))
+		return -1;
+
+	memcpy(node->path, path, plen);
+	memcpy(node->path + plen, devname, nlen);
+	node->devname = node->path + plen;
+
+	node->type = st->st_mode & S_IFMT;
+	node->dev = st->st_rdev;
+	xdev_devnode_key(node->key, sizeof(node->key), node->type, node->dev);
+
+	if (__predict_false(xdev_hash_put(&dn->bypath, node->path,
+	    node) == -1))
+		goto fail;
+
+	/* Links to the same node: the first one found is kept. */
+	if (xdev_hash_get(&dn->bydev, node->key) == NULL &&
+	    __predict_false(xdev_hash_put(&dn->bydev, node->key, node) == -1))
+		goto fail2;
+
+	node->next = (struct xdev_devnode *)xdev_hash_get(&dn->byname,
+		node->devname);
+	if (__predict_false(xdev_hash_put(&dn->byname, node->devname,
+	    node) == -1))
+		goto fail3;
+
+	return 0;
+
+fail3:
+	if (xdev_hash_get(&dn->bydev, node->key) == node)
+		xdev_hash_remove(&dn->bydev, node->key);
+fail2:
+	xdev_hash_remove(&dn->bypath, node->path);
+fail:
+	free(node);
+
+	return -1;
+}
+
+static void
+xdev_devnodes_remove(struct xdev_devnodes *dn, struct xdev_devnode *node)
+{
+	struct xdev_devnode *prev;
+
+	xdev_hash_remove(&dn->bypath, node->path);
+
+	if (xdev_hash_get(&dn->bydev, node->key) == node)
+		xdev_hash_remove(&dn->bydev, node->key);
+
+	prev = (struct xdev_devnode *)xdev_hash_get(&dn->byname,
+		node->devname);
+	if (prev == node) {
+		/*
+		 * Replacing a present key does not fail.  The key goes
+		 * with the node, the next one has to bring its own.
+		 */
+		if (node->next != NULL)
+			xdev_hash_put(&dn->byname, node->next->devname,
+			    node->next);
+		else
+			xdev_hash_remove(&dn->byname, node->devname);
+	} else {
+		while (prev->next != node)
+			prev = prev->next;
+		prev->next = node->next;
+	}
+
+	free(node);
+}
+
+static void
+xdev_devnodes_clear_dirty(struct xdev_devnodes *dn)
+{
+	struct xdev_hash_entry *e;
+
+	xdev_hash_foreach(e, &dn->dirty)
+		free(e->value);
+	xdev_hash_clear(&dn->dirty);
+}
+
+static void
+xdev_devnodes_clear(struct xdev_devnodes *dn)
+{
+	struct xdev_hash_entry *e;
+
+	xdev_hash_foreach(e, &dn->bypath)
+		free(e->value);
+
+	xdev_hash_clear(&dn->bypath);
+	xdev_hash_clear(&dn->bydev);
+	xdev_hash_clear(&dn->byname);
+	xdev_devnodes_clear_dirty(dn);
+}
+
+static int
+xdev_devnodes_scan(struct xdev_devnodes *dn)
+{
+	struct kinfo_drivers *kid;
+	struct dirent *de;
+	struct stat st;
+	char name[64];
+	char path[PATH_MAX];
+	size_t cnt;
+	DIR *dir;
+
+	kid = kinfo_getdrivers(&cnt);
+	if (__predict_false(kid == NULL))
+		return -1;
+
+	dir = opendir(dn->dir);
+	if (__predict_false(dir == NULL))
+		goto fail;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_type != DT_CHR && de->d_type != DT_BLK &&
+		    de->d_type != DT_UNKNOWN)
+			continue;
+
+		if (fstatat(dirfd(dir), de->d_name, &st,
+		    AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+
+		if (!S_ISCHR(st.st_mode) && !S_ISBLK(st.st_mode))
+			continue;
+
+		if (!xdev_devnode_devname(kid, cnt, &st, name, sizeof(name)))
+			continue;
+
+		snprintf(path, sizeof(path), "%s%s", dn->dir, de->d_name);
+
+		if (__predict_false(xdev_devnodes_add(dn, path, name,
+		    &st) == -1))
+			goto fail2;
+	}
+
+	closedir(dir);
+	free(kid);
+
+	return 0;
+
+fail2:
+	closedir(dir);
+fail:
+	free(kid);
+
+	return -1;
+}
+
+/*
+ * Look at the nodes of devname again: drop those that are gone and
+ * pick up new ones named after it, as devpubd(8) makes for wedges.
+ */
+static int
+xdev_devnodes_refresh(struct xdev_devnodes *dn,
+	const struct kinfo_drivers *kid, size_t cnt, const char *devname)
+{
+	struct xdev_devnode *node, *next;
+	struct stat st;
+	char name[64];
+	char path[PATH_MAX];
+	int p, r;
+
+	node = (struct xdev_devnode *)xdev_hash_get(&dn->byname, devname);
+	for (; node != NULL; node = next) {
+		next = node->next;
+		if (lstat(node->path, &st) == 0 &&
+		    (st.st_mode & S_IFMT) == node->type &&
+		    st.st_rdev == node->dev)
+			continue;
+		xdev_devnodes_remove(dn, node);
+	}
+
+	for (r = 0; r < 2; r++) {
+		for (p = -1; p < MAXPARTITIONS; p++) {
+			if (p == -1)
+				snprintf(path, sizeof(path), "%s%s%s", dn->dir,
+				    r ? "r" : "", devname);
+			else
+				snprintf(path, sizeof(path), "%s%s%s%c",
+				    dn->dir, r ? "r" : "", devname, 'a' + p);
+
+			if (xdev_hash_get(&dn->bypath, path) != NULL)
+				continue;
+
+			if (lstat(path, &st) == -1)
+				continue;
+
+			if (!S_ISCHR(st.st_mode) && !S_ISBLK(st.st_mode))
+				continue;
+
+			if (!xdev_devnode_devname(kid, cnt, &st, name,
+			    sizeof(name)) || strcmp(name, devname) != 0)
+				continue;
+
+			if (__predict_false(xdev_devnodes_add(dn, path, name,
+			    &st) == -1))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Bring the index up to date before a lookup.  Called with the mutex
+ * held.
+ */
+static int
+xdev_devnodes_update(struct xdev_devnodes *dn)
+{
+	struct kinfo_drivers *kid;
+	struct xdev_hash_entry *e;
+	size_t cnt;
+	int rv;
+
+	if (!dn->built) {
+		xdev_devnodes_clear(dn);
+		if (__predict_false(xdev_devnodes_scan(dn) == -1))
+			return -1;
+		dn->built = true;
+		return 0;
+	}
+
+	if (dn->dirty.count == 0)
+		return 0;
+
+	kid = kinfo_getdrivers(&cnt);
+	if (__predict_false(kid == NULL))
+		return -1;
+
+	rv = 0;
+	xdev_hash_foreach(e, &dn->dirty) {
+		if (__predict_false(xdev_devnodes_refresh(dn, kid, cnt,
+		    e->key) == -1)) {
+			rv = -1;
+			break;
+		}
+	}
+
+	if (__predict_true(rv == 0))
+		xdev_devnodes_clear_dirty(dn);
+
+	free(kid);
+
+	return rv;
+}
+
+int
+xdev_devnodes_init(struct xdev_devnodes *dn)
+{
+	int error;
+
+	assert(dn != NULL);
+
+	memset(dn, 0, sizeof(*dn));
+
+	error = pthread_mutex_init(&dn->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&dn->bypath, 0) == -1))
+		goto fail;
+	if (__predict_false(xdev_hash_init(&dn->bydev, 0) == -1))
+		goto fail2;
+	if (__predict_false(xdev_hash_init(&dn->byname, 0) == -1))
+		goto fail3;
+	if (__predict_false(xdev_hash_init(&dn->dirty, 0) == -1))
+		goto fail4;
+
+	dn->dir = _PATH_DEV;
+
+	return 0;
+
+fail4:
+	xdev_hash_fini(&dn->byname);
+fail3:
+	xdev_hash_fini(&dn->bydev);
+fail2:
+	xdev_hash_fini(&dn->bypath);
+fail:
+	pthread_mutex_destroy(&dn->mutex);
+
+	return -1;
+}
+
+void
+xdev_devnodes_fini(struct xdev_devnodes *dn)
+{
+
+	assert(dn != NULL);
+
+	xdev_devnodes_clear(dn);
+
+	xdev_hash_fini(&dn->dirty);
+	xdev_hash_fini(&dn->byname);
+	xdev_hash_fini(&dn->bydev);
+	xdev_hash_fini(&dn->bypath);
+	pthread_mutex_destroy(&dn->mutex);
+}
+
+/*
+ * Note that devname attached or detached.  Its nodes are looked at
+ * again before the next lookup.
+ */
+int
+xdev_devnodes_invalidate(struct xdev_devnodes *dn, const char *devname)
+{
+	char *name;
+	int rv;
+
+	assert(dn != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&dn->mutex);
+	rv = 0;
+	if (dn->built && xdev_hash_get(&dn->dirty, devname) == NULL) {
+		name = strdup(devname);
+		if (__predict_false(name == NULL) ||
+		    __predict_false(xdev_hash_put(&dn->dirty, name,
+		    name) == -1)) {
+			free(name);
+			/* Start over rather than miss a change. */
+			dn->built = false;
+			rv = -1;
+		}
+	}
+	pthread_mutex_unlock(&dn->mutex);
+
+	return rv;
+}
+
+/*
+ * Store copies of up to max paths of the nodes of devname in paths, for
+ * the caller to free.  Returns the number of nodes, which may be more
+ * than max.
+ */
+ssize_t
+xdev_devnodes_get(struct xdev_devnodes *dn, const char *devname,
+	char **paths, size_t max)
+{
+	struct xdev_devnode *node;
+	ssize_t i, n;
+
+	assert(dn != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&dn->mutex);
+	if (__predict_false(xdev_devnodes_update(dn) == -1)) {
+		pthread_mutex_unlock(&dn->mutex);
+		return -1;
+	}
+
+	n = 0;
+	node = (struct xdev_devnode *)xdev_hash_get(&dn->byname, devname);
+	for (; node != NULL; node = node->next) {
+		if ((size_t)n < max) {
+			paths[n] = strdup(node->path);
+			if (__predict_false(paths[n] == NULL))
+				goto fail;
+		}
+		n++;
+	}
+	pthread_mutex_unlock(&dn->mutex);
+
+	return n;
+
+fail:
+	pthread_mutex_unlock(&dn->mutex);
+	for (i = 0; i < n; i++)
+		free(paths[i]);
+
+	return -1;
+}
+
+/* Called with the mutex held. */
+static int
+xdev_devnodes_copy(const struct xdev_devnode *node, char *devname,
+	size_t len)
+{
+
+	if (node == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (__predict_false(strlcpy(devname, node->devname, len) >= len)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+xdev_devnodes_lookup_path(struct xdev_devnodes *dn, const char *path,
+	char *devname, size_t len)
+{
+	struct xdev_devnode *node;
+	int rv;
+
+	assert(dn != NULL);
+	assert(path != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&dn->mutex);
+	if (__predict_false(xdev_devnodes_update(dn) == -1)) {
+		pthread_mutex_unlock(&dn->mutex);
+		return -1;
+	}
+
+	node = (struct xdev_devnode *)xdev_hash_get(&dn->bypath, path);
+	rv = xdev_devnodes_copy(node, devname, len);
+	pthread_mutex_unlock(&dn->mutex);
+
+	return rv;
+}
+
+int
+xdev_devnodes_lookup_dev(struct xdev_devnodes *dn, mode_t type, dev_t dev,
+	char *devname, size_t len)
+{
+	struct xdev_devnode *node;
+	char key[32];
+	int rv;
+
+	assert(dn != NULL);
+	assert(devname != NULL);
+
+	xdev_devnode_key(key, sizeof(key), type, dev);
+
+	pthread_mutex_lock(&dn->mutex);
+	if (__predict_false(xdev_devnodes_update(dn) == -1)) {
+		pthread_mutex_unlock(&dn->mutex);
+		return -1;
+	}
+
+	node = (struct xdev_devnode *)xdev_hash_get(&dn->bydev, key);
+	rv = xdev_devnodes_copy(node, devname, len);
+	pthread_mutex_unlock(&dn->mutex);
+
+	return rv;
+}
@@ -0,0 +1,80 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_DEVNODE_H_
+#define _XDEV_DEVNODE_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "xdev_hash.h"
+
+/* Nodes come and go with hotplug: they own their path and devname. */
+struct xdev_devnode {
+	const char *devname;		/* after path */
+	mode_t type;			/* S_IFCHR or S_IFBLK */
+	dev_t dev;
+	char key[32];			/* type and dev, for bydev */
+	struct xdev_devnode *next;	/* of the same devname */
+	char path[];
+};
+
+/*
+ * The character and block special files in /dev, by path, by dev_t and
+ * by the device they belong to.  Built by one scan of the directory on
+ * first use; afterwards only the nodes of devices that attached or
+ * detached since are looked at again.
+ */
+struct xdev_devnodes {
+	pthread_mutex_t mutex;
+	const char *dir;
+	bool built;
+	struct xdev_hash bypath;	/* path -> node */
+	struct xdev_hash bydev;		/* key -> node */
+	struct xdev_hash byname;	/* devname -> first node */
+	struct xdev_hash dirty;		/* devnames to look at again, owned */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_devnodes_init(struct xdev_devnodes *);
+void xdev_devnodes_fini(struct xdev_devnodes *);
+int xdev_devnodes_invalidate(struct xdev_devnodes *, const char *);
+ssize_t xdev_devnodes_get(struct xdev_devnodes *, const char *, char **,
+	size_t);
+int xdev_devnodes_lookup_path(struct xdev_devnodes *, const char *, char *,
+	size_t);
+int xdev_devnodes_lookup_dev(struct xdev_devnodes *, mode_t, dev_t, char *,
+	size_t);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_DEVNODE_H_ */
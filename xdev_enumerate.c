@@ -43,7 +43,10 @@ __RCSID("$NetBSD$");
 #include <string.h>
 
 #include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_device.h"
 #include "xdev_enumerate.h"
+#include "xdev_hash.h"
 #include "xdev_list.h"
 #include "xdev_private.h"
 
@@ -71,6 +74,12 @@ xdev_enumerate_new(struct xdev *x)
 	xe->magic = XDEV_ENUMERATE_MAGIC;
 	xe->xdev = x;
 	TAILQ_INIT(&xe->devices);
+	xdev_arena_init(&xe->arena);
+
+	if (__predict_false(xdev_hash_init(&xe->topology, 0) == -1)) {
+		free(xe);
+		return NULL;
+	}
 
 	return xe;
 }
@@ -94,6 +103,113 @@ xdev_enumerate_ref(struct xdev_enumerate *xe)
 	return xe;
 }
 
+static struct xdev_enumerate_node *
+xdev_enumerate_node(struct xdev_enumerate *xe, const char *devname)
+{
+	struct xdev_enumerate_node *node;
+	size_t len;
+
+	node = (struct xdev_enumerate_node *)xdev_hash_get(&xe->topology,
+		devname);
+	if (node != NULL)
+		return node;
+
+	len = strlen(devname) + 1;
+	node = (struct xdev_enumerate_node *)calloc(1, sizeof(*node) + len);
+	if (__predict_false(node == NULL))
+		return NULL;
+	LIST_INIT(&node->children);
+	memcpy(node->devname, devname, len);
+
+	if (__predict_false(xdev_hash_put(&xe->topology, node->devname,
+	    node) == -1)) {
+		free(node);
+		return NULL;
+	}
+
+	return node;
+}
+
+/* Record devname under parent, which must be interned. */
+static struct xdev_enumerate_node *
+xdev_enumerate_topology_set(struct xdev_enumerate *xe, const char *devname,
+	const char *parent)
+{
+	struct xdev_enumerate_node *node, *up;
+
+	node = xdev_enumerate_node(xe, devname);
+	if (__predict_false(node == NULL))
+		return NULL;
+
+	if (node->link.parent == parent)
+		return node;
+
+	up = xdev_enumerate_node(xe, parent);
+	if (__predict_false(up == NULL))
+		return NULL;
+
+	if (node->link.parent != NULL)
+		LIST_REMOVE(node, sibling);
+	node->link.parent = parent;
+	LIST_INSERT_HEAD(&up->children, node, sibling);
+
+	return node;
+}
+
+static void
+xdev_enumerate_topology_clear(struct xdev_enumerate *xe)
+{
+	struct xdev_hash_entry *e;
+
+	xdev_hash_foreach(e, &xe->topology)
+		free(e->value);
+	xdev_hash_clear(&xe->topology);
+}
+
+/*
+ * Drop the devices and the topology of the last scan.  Arena devices
+ * someone still holds on to keep the chunks of the scan, which are
+ * then freed with the last of them instead of reused.
+ */
+static void
+xdev_enumerate_release(struct xdev_enumerate *xe)
+{
+	struct xdev_list_entry *entry;
+	struct xdev_arena_hold *hold;
+	struct xdev_device *xd;
+
+	xdev_enumerate_topology_clear(xe);
+
+	if (!xe->use_arena) {
+		xdev_list_free(&xe->devices);
+		return;
+	}
+
+	hold = NULL;
+	TAILQ_FOREACH(entry, &xe->devices, link) {
+		if (entry->device->refcnt > 1) {
+			hold = xdev_arena_detach(&xe->arena);
+			break;
+		}
+	}
+
+	/* The entries are in the arena too. */
+	while ((entry = TAILQ_FIRST(&xe->devices)) != NULL) {
+		TAILQ_REMOVE(&xe->devices, entry, link);
+		xd = entry->device;
+		if (hold != NULL) {
+			xdev_arena_hold_ref(hold);
+			xd->hold = hold;
+		}
+		xdev_device_unref(xd);
+	}
+
+	if (hold != NULL)
+		xdev_arena_hold_unref(hold);
+	else
+		xdev_arena_reset(&xe->arena);
+}
+
 struct xdev_enumerate *
 xdev_enumerate_unref(struct xdev_enumerate *xe)
 {
@@ -109,7 +225,11 @@ xdev_enumerate_unref(struct xdev_enumerate *xe)
 	}
 
 	if (xe->refcnt == 1) {
-		xdev_list_free(&xe->devices);
+		xdev_enumerate_release(xe);
+		xdev_arena_fini(&xe->arena);
+		if (xe->command != NULL)
+			prop_object_release(xe->command);
+		xdev_hash_fini(&xe->topology);
 		xe->magic = 0xdeadbeef;
 		free(xe);
 		return NULL;
@@ -160,12 +280,183 @@ xdev_enumerate_filter(struct xdev_enumerate *xe, xdev_filter_cb xfcb,
 	return 0;
 }
 
+/*
+ * In lazy mode a scan records only the names and the topology from
+ * DRVLISTDEV.  The properties of a device are fetched the first time
+ * an accessor needs them.
+ */
+int
+xdev_enumerate_set_lazy(struct xdev_enumerate *xe, bool lazy)
+{
+
+	if (__predict_false(xe == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xe->magic != XDEV_ENUMERATE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xe->lazy = lazy;
+
+	return 0;
+}
+
+/*
+ * In arena mode the devices and list entries of a scan are carved out
+ * of large chunks and all freed at once by the next scan or the last
+ * unref, instead of one by one.  The devices keep the reply of
+ * drvctl(4) and bypass the lookup cache.  A device still referenced
+ * then keeps all chunks of its scan until its last unref; use
+ * xdev_device_copy() to keep one without them.  Switching drops the
+ * devices of the last scan.  Rescanning is not supported in arena
+ * mode.
+ */
+int
+xdev_enumerate_set_arena(struct xdev_enumerate *xe, bool use_arena)
+{
+
+	if (__predict_false(xe == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xe->magic != XDEV_ENUMERATE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (xe->use_arena != use_arena) {
+		xdev_enumerate_release(xe);
+		xe->num_devices = 0;
+		xe->use_arena = use_arena;
+	}
+
+	return 0;
+}
+
+/*
+ * Called by the walker for every device found, consumes the reference.
+ * Returns -1 on error, 1 to stop the walk, 0 otherwise.
+ */
+typedef int (*xdev_enumerate_visit_t)(struct xdev_enumerate *,
+	struct xdev_device *, void *);
+
+struct xdev_enumerate_collect {
+	struct xdev_list *list;
+	bool rescan;			/* list is not the devices */
+	struct xdev_arena *arena;	/* for the entries, may be NULL */
+};
+
+struct xdev_enumerate_stream {
+	xdev_enumerate_cb cb;
+	void *cookie;
+	int count;
+};
+
+/*
+ * Record the device in the topology, then append it to the list if it
+ * passes the filter.
+ */
+static int
+xdev_enumerate_collect(struct xdev_enumerate *xe, struct xdev_device *device,
+	void *cookie)
+{
+	struct xdev_enumerate_collect *xc;
+	struct xdev_enumerate_node *node;
+	struct xdev_list_entry *entry;
+
+	xc = (struct xdev_enumerate_collect *)cookie;
+
+	/* Parents are interned, they outlive the device. */
+	node = xdev_enumerate_topology_set(xe, device->devname,
+		device->parent);
+	if (__predict_false(node == NULL))
+		goto fail;
+
+	node->generation = xe->generation;
+
+	if (xe->xfcb && xe->xfcb(device, xe->xfcb_cookie) != 0) {
+		xdev_device_unref(device);
+		return 0;
+	}
+
+	if (xc->arena != NULL) {
+		entry = (struct xdev_list_entry *)xdev_arena_alloc(xc->arena,
+			sizeof(*entry));
+		if (__predict_false(entry == NULL))
+			goto fail;
+		entry->device = device;
+		entry->magic = XDEV_LIST_ENTRY_MAGIC;
+	} else {
+		entry = xdev_list_entry_new(device);
+		if (__predict_false(entry == NULL))
+			goto fail;
+	}
+
+	TAILQ_INSERT_TAIL(xc->list, entry, link);
+	if (!xc->rescan)
+		node->entry = entry;
+
+	return 0;
+
+fail:
+	xdev_device_unref(device);
+	return -1;
+}
+
+static int
+xdev_enumerate_stream(struct xdev_enumerate *xe, struct xdev_device *device,
+	void *cookie)
+{
+	struct xdev_enumerate_stream *xs;
+	int stop;
+
+	xs = (struct xdev_enumerate_stream *)cookie;
+
+	if (xe->xfcb && xe->xfcb(device, xe->xfcb_cookie) != 0) {
+		xdev_device_unref(device);
+		return 0;
+	}
+
+	xs->count++;
+	stop = xs->cb(device, xs->cookie);
+	xdev_device_unref(device);
+
+	return stop != 0 ? 1 : 0;
+}
+
+static struct xdev_device *
+xdev_enumerate_device(struct xdev_enumerate *xe, struct xdev_arena *xa,
+	const char *devname, const char *parent)
+{
+
+	if (xe->lazy)
+		return xdev_device_new_lazy(xe->xdev, xa, devname, parent);
+
+	if (xa == NULL)
+		return xdev_device_from_devname(xe->xdev, devname);
+
+	if (xe->command == NULL) {
+		xe->command = xdev_device_command_new();
+		if (__predict_false(xe->command == NULL))
+			return NULL;
+	}
+
+	return xdev_device_fetch_arena(xe->xdev, xa, xe->command, devname);
+}
+
+/*
+ * Devices are allocated in xa, if not NULL.
+ */
 static int
 xdev_enumerate_scan_devices_recursive(struct xdev_enumerate *xe,
-	const char *devname, int depth, int max_depth)
+	struct xdev_arena *xa, const char *devname, int depth, int max_depth,
+	xdev_enumerate_visit_t visit, void *cookie)
 {
 	struct xdev_device *device;
-	struct xdev_list_entry *entry;
 	char *child;
 	struct devlistargs laa;
 	size_t i, children;
@@ -206,38 +497,38 @@ retry:
 
         for (i = 0; i < children; i++) {
 		child = laa.l_childname[i];
-		device = xdev_device_from_devname(xe->xdev, child);
+		device = xdev_enumerate_device(xe, xa, child, devname);
 		if (__predict_false(device == NULL)) {
+			if (xe->lazy)
+				goto fail;
 			/* Device detached? */
 			continue;
 		}
 
-		ret = xdev_enumerate_scan_devices_recursive(xe, child,
-			depth + 1, max_depth);
-		if (__predict_false(ret == -1)) {
+		ret = xdev_enumerate_scan_devices_recursive(xe, xa, child,
+			depth + 1, max_depth, visit, cookie);
+		if (__predict_false(ret != 0)) {
 			xdev_device_unref(device);
-			goto fail;
-		}
-
-		if (xe->xfcb && xe->xfcb(device, xe->xfcb_cookie) != 0) {
-			xdev_device_unref(device);
-			continue;
+			if (ret == -1)
+				goto fail;
+			goto stop;
 		}
 
-		entry = xdev_list_entry_new(device);
-		if (__predict_false(entry == NULL)) {
-			xdev_device_unref(device);
+		ret = (*visit)(xe, device, cookie);
+		if (__predict_false(ret == -1))
 			goto fail;
-		}
-
-		TAILQ_INSERT_TAIL(&xe->devices, entry, link);
-		++xe->num_devices;
+		if (ret == 1)
+			goto stop;
         }
 
 end:
 	free(laa.l_childname);
 	return 0;
 
+stop:
+	free(laa.l_childname);
+	return 1;
+
 fail:
 	free(laa.l_childname);
 	return -1;
@@ -247,6 +538,8 @@ int
 xdev_enumerate_scan_devices(struct xdev_enumerate *xe, const char *root_devname,
 	int max_depth)
 {
+	struct xdev_enumerate_collect xc;
+	struct xdev_list_entry *entry;
 	int ret;
 
 	if (__predict_false(xe == NULL)) {
@@ -260,19 +553,377 @@ xdev_enumerate_scan_devices(struct xdev_enumerate *xe, const char *root_devname,
 	}
 
 	xe->num_devices = 0;
-	xdev_list_free(&xe->devices);
+	xdev_enumerate_release(xe);
 	TAILQ_INIT(&xe->devices);
 
-	ret = xdev_enumerate_scan_devices_recursive(xe, root_devname, 0,
-		max_depth);
+	xc.list = &xe->devices;
+	xc.rescan = false;
+	xc.arena = xe->use_arena ? &xe->arena : NULL;
+
+	ret = xdev_enumerate_scan_devices_recursive(xe, xc.arena,
+		root_devname, 0, max_depth, xdev_enumerate_collect, &xc);
 	if (__predict_false(ret == -1)) {
-		xdev_list_free(&xe->devices);
+		xdev_enumerate_release(xe);
 		return -1;
 	}
 
+	TAILQ_FOREACH(entry, &xe->devices, link)
+		++xe->num_devices;
+
+	/* A walk of the whole tree is all the ancestry map needs. */
+	xdev_ancestry_merge(&xe->xdev->ancestry, &xe->topology,
+		root_devname[0] == '\0' && max_depth == XDEV_INF_DEPTH);
+
 	return xe->num_devices;
 }
 
+/*
+ * Like xdev_enumerate_scan_devices(), in the same order, but hand every
+ * device to cb as soon as it is found instead of collecting them.  The
+ * device is only borrowed for the call.  A non-zero return from cb
+ * stops the walk.  Returns the number of devices passed to cb.
+ */
+int
+xdev_enumerate_scan_devices_cb(struct xdev_enumerate *xe,
+	const char *root_devname, int max_depth, xdev_enumerate_cb cb,
+	void *cb_cookie)
+{
+	struct xdev_enumerate_stream xs;
+	int ret;
+
+	if (__predict_false(xe == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xe->magic != XDEV_ENUMERATE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(cb == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xs.cb = cb;
+	xs.cookie = cb_cookie;
+	xs.count = 0;
+
+	ret = xdev_enumerate_scan_devices_recursive(xe, NULL, root_devname, 0,
+		max_depth, xdev_enumerate_stream, &xs);
+	if (__predict_false(ret == -1))
+		return -1;
+
+	return xs.count;
+}
+
+static bool
+xdev_enumerate_same(struct xdev_device *a, struct xdev_device *b)
+{
+	const char *xa, *xb;
+
+	if (a == b)
+		return true;
+
+	/* Parents are interned. */
+	if (a->parent != b->parent)
+		return false;
+
+	/* Only the topology is known, do not fetch the rest for this. */
+	if ((a->flags | b->flags) & XDEV_DEVICE_LAZY)
+		return true;
+
+	if (a->driver != b->driver || a->unit != b->unit)
+		return false;
+
+	if (xdev_device_externalize(a, &xa) == -1 ||
+	    xdev_device_externalize(b, &xb) == -1)
+		return false;
+
+	return strcmp(xa, xb) == 0;
+}
+
+static void
+xdev_enumerate_entry_free(struct xdev_list_entry *entry)
+{
+
+	xdev_device_unref(entry->device);
+	entry->magic = 0xdeadbeef;
+	free(entry);
+}
+
+/*
+ * Forget node and everything below it, telling cb about the devices
+ * listed.
+ */
+static int
+xdev_enumerate_forget(struct xdev_enumerate *xe,
+	struct xdev_enumerate_node *node, xdev_diff_cb cb, void *cb_cookie)
+{
+	struct xdev_enumerate_node *child, *next;
+	struct xdev_list_entry *entry;
+	int changes;
+
+	changes = 0;
+	for (child = LIST_FIRST(&node->children); child != NULL;
+	    child = next) {
+		next = LIST_NEXT(child, sibling);
+		changes += xdev_enumerate_forget(xe, child, cb, cb_cookie);
+	}
+
+	xdev_ancestry_update(&xe->xdev->ancestry, "device-detach",
+		node->devname, node->link.parent);
+
+	if ((entry = node->entry) != NULL) {
+		TAILQ_REMOVE(&xe->devices, entry, link);
+		--xe->num_devices;
+		++changes;
+		if (cb != NULL)
+			(*cb)(entry->device, XDEV_DIFF_REMOVED, cb_cookie);
+		xdev_enumerate_entry_free(entry);
+	}
+
+	LIST_REMOVE(node, sibling);
+	xdev_hash_remove(&xe->topology, node->devname);
+	free(node);
+
+	return changes;
+}
+
+/*
+ * Go through what is known below node, level levels down from the root
+ * of a rescan: whatever the rescan did not see there, or below what it
+ * did not see, is gone.  Below the last level walked nothing is known.
+ */
+static int
+xdev_enumerate_prune(struct xdev_enumerate *xe,
+	struct xdev_enumerate_node *node, int level, int max_depth,
+	xdev_diff_cb cb, void *cb_cookie)
+{
+	struct xdev_enumerate_node *child, *next;
+	int changes;
+
+	changes = 0;
+	for (child = LIST_FIRST(&node->children); child != NULL;
+	    child = next) {
+		next = LIST_NEXT(child, sibling);
+		if (child->generation != xe->generation) {
+			changes += xdev_enumerate_forget(xe, child, cb,
+			    cb_cookie);
+			continue;
+		}
+
+		xdev_ancestry_update(&xe->xdev->ancestry, "device-attach",
+			child->devname, child->link.parent);
+
+		if (max_depth == XDEV_INF_DEPTH || level <= max_depth)
+			changes += xdev_enumerate_prune(xe, child, level + 1,
+			    max_depth, cb, cb_cookie);
+	}
+
+	return changes;
+}
+
+/*
+ * Rescan the devices below devname, down to max_depth levels, and merge
+ * the result into the current list.  Unchanged entries are kept as they
+ * are, changed or reparented ones get the new device in place and new
+ * ones go in front of devname's own entry (or at the end).  cb, if not
+ * NULL, is told about every change, with the device borrowed for the
+ * call.  Only the subtree is looked at, through the topology of the
+ * earlier scans.  Returns the number of changes.
+ */
+int
+xdev_enumerate_rescan(struct xdev_enumerate *xe, const char *devname,
+	int max_depth, xdev_diff_cb cb, void *cb_cookie)
+{
+	struct xdev_enumerate_collect xc;
+	struct xdev_enumerate_node *node, *root;
+	struct xdev_list_entry *entry, *anchor, *old;
+	struct xdev_list fresh;
+	int changes, kind;
+
+	if (__predict_false(xe == NULL || devname == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xe->magic != XDEV_ENUMERATE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Kept entries would outlive the arena they are in. */
+	if (__predict_false(xe->use_arena)) {
+		errno = ENOTSUP;
+		return -1;
+	}
+
+	/* Only the nodes the walk sees get the new generation. */
+	xe->generation++;
+
+	TAILQ_INIT(&fresh);
+	xc.list = &fresh;
+	xc.rescan = true;
+	xc.arena = NULL;
+
+	if (__predict_false(xdev_enumerate_scan_devices_recursive(xe, NULL,
+	    devname, 0, max_depth, xdev_enumerate_collect, &xc) == -1)) {
+		xdev_list_free(&fresh);
+		return -1;
+	}
+
+	/* Nothing can fail from here on. */
+	root = (struct xdev_enumerate_node *)xdev_hash_get(&xe->topology,
+		devname);
+	anchor = root != NULL ? root->entry : NULL;
+	changes = 0;
+
+	while ((entry = TAILQ_FIRST(&fresh)) != NULL) {
+		TAILQ_REMOVE(&fresh, entry, link);
+
+		node = (struct xdev_enumerate_node *)xdev_hash_get(
+			&xe->topology, entry->device->devname);
+		assert(node != NULL);
+
+		if ((old = node->entry) == NULL) {
+			if (anchor != NULL)
+				TAILQ_INSERT_BEFORE(anchor, entry, link);
+			else
+				TAILQ_INSERT_TAIL(&xe->devices, entry, link);
+			node->entry = entry;
+			++xe->num_devices;
+			++changes;
+			if (cb != NULL)
+				(*cb)(entry->device, XDEV_DIFF_ADDED,
+				    cb_cookie);
+			continue;
+		}
+
+		if (xdev_enumerate_same(old->device, entry->device)) {
+			xdev_enumerate_entry_free(entry);
+			continue;
+		}
+
+		kind = old->device->parent != entry->device->parent ?
+		    XDEV_DIFF_REPARENTED : XDEV_DIFF_CHANGED;
+		xdev_device_unref(old->device);
+		old->device = entry->device;
+		entry->magic = 0xdeadbeef;
+		free(entry);
+		++changes;
+		if (cb != NULL)
+			(*cb)(old->device, kind, cb_cookie);
+	}
+
+	/*
+	 * The topology also covers the devices the filter keeps out of the
+	 * list, so a filtered out parent going away still takes its listed
+	 * children along.
+	 */
+	if (root != NULL)
+		changes += xdev_enumerate_prune(xe, root, 1, max_depth, cb,
+		    cb_cookie);
+
+	return changes;
+}
+
+/*
+ * Report how the devices listed by b differ from those listed by a, in
+ * time linear in their number: devices only b lists are added, those
+ * only a lists removed, and devices under another parent or with other
+ * properties (by fingerprint) reparented or changed, possibly both.
+ * cb, if not NULL, gets the device from b, or from a for removals,
+ * borrowed for the call.  Comparing properties fetches those of lazy
+ * devices.  Returns the number of differences.
+ */
+int
+xdev_enumerate_diff(struct xdev_enumerate *a, struct xdev_enumerate *b,
+	xdev_diff_cb cb, void *cb_cookie)
+{
+	struct xdev_list_entry *entry;
+	struct xdev_device *old, *xd;
+	struct xdev_hash byname;
+	uint64_t fa, fb;
+	int changes;
+
+	if (__predict_false(a == NULL || b == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(a->magic != XDEV_ENUMERATE_MAGIC ||
+	    b->magic != XDEV_ENUMERATE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&byname, a->num_devices) == -1))
+		return -1;
+
+	TAILQ_FOREACH(entry, &a->devices, link) {
+		if (__predict_false(xdev_hash_put(&byname,
+		    entry->device->devname, entry->device) == -1))
+			goto fail;
+	}
+
+	changes = 0;
+
+	TAILQ_FOREACH(entry, &b->devices, link) {
+		xd = entry->device;
+
+		old = (struct xdev_device *)xdev_hash_remove(&byname,
+			xd->devname);
+		if (old == NULL) {
+			++changes;
+			if (cb != NULL)
+				(*cb)(xd, XDEV_DIFF_ADDED, cb_cookie);
+			continue;
+		}
+
+		if (old == xd)
+			continue;
+
+		/* Interned, unless a and b come from different xdevs. */
+		if (old->parent != xd->parent &&
+		    strcmp(old->parent, xd->parent) != 0) {
+			++changes;
+			if (cb != NULL)
+				(*cb)(xd, XDEV_DIFF_REPARENTED, cb_cookie);
+		}
+
+		if (__predict_false(
+		    xdev_device_get_fingerprint(old, &fa) == -1 ||
+		    xdev_device_get_fingerprint(xd, &fb) == -1))
+			goto fail;
+
+		if (fa != fb) {
+			++changes;
+			if (cb != NULL)
+				(*cb)(xd, XDEV_DIFF_CHANGED, cb_cookie);
+		}
+	}
+
+	/* What is left was not matched. */
+	TAILQ_FOREACH(entry, &a->devices, link) {
+		if (xdev_hash_get(&byname, entry->device->devname) == NULL)
+			continue;
+		++changes;
+		if (cb != NULL)
+			(*cb)(entry->device, XDEV_DIFF_REMOVED, cb_cookie);
+	}
+
+	xdev_hash_fini(&byname);
+
+	return changes;
+
+fail:
+	xdev_hash_fini(&byname);
+
+	return -1;
+}
+
 struct xdev_list_entry *
 xdev_enumerate_get_list_entry(struct xdev_enumerate *xe)
 {
@@ -31,19 +31,46 @@
 #ifndef _XDEV_ENUMERATE_H_
 #define _XDEV_ENUMERATE_H_
 
+#include <sys/queue.h>
+
+#include <stdbool.h>
+
 #include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_arena.h"
+#include "xdev_hash.h"
 #include "xdev_list.h"
 
 #define XDEV_ENUMERATE_MAGIC 0x492023c5
 
+/*
+ * A device seen by the last scans, it outlives the device itself.
+ * Names only known as parents have nodes too, with a NULL parent, so
+ * that every subtree can be walked from its root.
+ */
+struct xdev_enumerate_node {
+	struct xdev_ancestry_link link;
+	LIST_HEAD(, xdev_enumerate_node) children;
+	LIST_ENTRY(xdev_enumerate_node) sibling;
+	struct xdev_list_entry *entry;	/* in devices, if listed */
+	unsigned int generation;	/* of the last scan seeing it */
+	char devname[];
+};
+
 struct xdev_enumerate {
 	int refcnt;
 	int magic;
 	struct xdev *xdev;
 	xdev_filter_cb xfcb;
 	void *xfcb_cookie;
+	bool lazy;
+	bool use_arena;
+	struct xdev_arena arena;	/* devices and entries of the scan */
+	prop_dictionary_t command;	/* get-properties, for arena scans */
 	struct xdev_list devices;
 	int num_devices;
+	struct xdev_hash topology;	/* devname -> node, unfiltered */
+	unsigned int generation;
 };
 
 #endif /* !_XDEV_ENUMERATE_H_ */
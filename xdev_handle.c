@@ -0,0 +1,449 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev.h"
+#include "xdev_device.h"
+#include "xdev_handle.h"
+#include "xdev_hash.h"
+#include "xdev_private.h"
+
+#define XDEV_HANDLE_MIN_SLOTS	64
+
+int
+xdev_handle_table_init(struct xdev_handle_table *t)
+{
+	int error;
+
+	assert(t != NULL);
+
+	memset(t, 0, sizeof(*t));
+
+	error = pthread_mutex_init(&t->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&t->index, 0) == -1)) {
+		pthread_mutex_destroy(&t->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+xdev_handle_table_fini(struct xdev_handle_table *t)
+{
+	uint32_t i;
+
+	assert(t != NULL);
+
+	for (i = 0; i < t->num_slots; i++) {
+		if (t->slots[i].device != NULL)
+			xdev_device_unref(t->slots[i].device);
+	}
+
+	free(t->slots);
+	xdev_hash_fini(&t->index);
+	pthread_mutex_destroy(&t->mutex);
+}
+
+/* Called with the mutex held. */
+static struct xdev_device *
+xdev_handle_table_resolve(struct xdev_handle_table *t, xdev_handle_t h)
+{
+	struct xdev_handle_slot *s;
+	uint32_t i;
+
+	i = h & XDEV_HANDLE_INDEX_MASK;
+	if (__predict_false(i >= t->num_slots))
+		return NULL;
+
+	s = &t->slots[i];
+	if (s->device == NULL || s->generation != h >> XDEV_HANDLE_INDEX_BITS)
+		return NULL;
+
+	return s->device;
+}
+
+/* Called with the mutex held. */
+static int
+xdev_handle_table_insert(struct xdev_handle_table *t, struct xdev_device *xd,
+	xdev_handle_t *hp)
+{
+	struct xdev_handle_slot *s;
+	uint32_t i, max;
+	int error;
+	void *v;
+
+	v = xdev_hash_get(&t->index, xd->devname);
+	if (v != NULL) {
+		i = (uint32_t)((uintptr_t)v - 1);
+		*hp = t->slots[i].generation << XDEV_HANDLE_INDEX_BITS | i;
+		return 0;
+	}
+
+	if (t->free_head != 0) {
+		i = t->free_head - 1;
+	} else {
+		if (t->num_slots == t->max_slots) {
+			if (__predict_false(
+			    t->max_slots > XDEV_HANDLE_INDEX_MASK / 2)) {
+				errno = ENOSPC;
+				return -1;
+			}
+			max = t->max_slots == 0 ? XDEV_HANDLE_MIN_SLOTS :
+			    t->max_slots * 2;
+			error = reallocarr(&t->slots, max, sizeof(*t->slots));
+			if (__predict_false(error != 0)) {
+				errno = error;
+				return -1;
+			}
+			t->max_slots = max;
+		}
+		i = t->num_slots;
+		t->slots[i].generation = 1;
+	}
+
+	if (__predict_false(xdev_hash_put(&t->index, xd->devname,
+	    (void *)((uintptr_t)i + 1)) == -1))
+		return -1;
+
+	s = &t->slots[i];
+	if (i == t->num_slots)
+		t->num_slots++;
+	else
+		t->free_head = s->next_free;
+
+	s->device = xdev_device_ref(xd);
+	s->next_free = 0;
+
+	*hp = s->generation << XDEV_HANDLE_INDEX_BITS | i;
+	return 0;
+}
+
+/*
+ * Called with the mutex held, once the index entry is gone.  Returns
+ * the device of the slot for the caller to unref after unlocking.
+ */
+static struct xdev_device *
+xdev_handle_table_free(struct xdev_handle_table *t, uint32_t i)
+{
+	struct xdev_handle_slot *s;
+	struct xdev_device *xd;
+
+	s = &t->slots[i];
+	xd = s->device;
+	s->device = NULL;
+	s->generation = (s->generation + 1) & XDEV_HANDLE_GEN_MASK;
+	if (s->generation == 0)
+		s->generation = 1;
+	s->next_free = t->free_head;
+	t->free_head = i + 1;
+
+	return xd;
+}
+
+/*
+ * Free the slot of devname, if any.  Handles to it go stale; the slot
+ * is reused with the next generation.
+ */
+void
+xdev_handle_table_invalidate(struct xdev_handle_table *t, const char *devname)
+{
+	struct xdev_device *xd;
+	void *v;
+
+	assert(t != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&t->mutex);
+
+	v = xdev_hash_remove(&t->index, devname);
+	if (v == NULL) {
+		pthread_mutex_unlock(&t->mutex);
+		return;
+	}
+
+	xd = xdev_handle_table_free(t, (uint32_t)((uintptr_t)v - 1));
+
+	pthread_mutex_unlock(&t->mutex);
+
+	xdev_device_unref(xd);
+}
+
+/*
+ * Resolve h and return its device with the table mutex held, or NULL
+ * with errno set.  Release with xdev_handle_unlock().
+ */
+static struct xdev_device *
+xdev_handle_lock(struct xdev *x, xdev_handle_t h)
+{
+	struct xdev_device *xd;
+
+	if (__predict_false(x == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (__predict_false(x->magic != XDEV_MAGIC)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&x->handles.mutex);
+
+	xd = xdev_handle_table_resolve(&x->handles, h);
+	if (__predict_false(xd == NULL)) {
+		pthread_mutex_unlock(&x->handles.mutex);
+		errno = ESTALE;
+		return NULL;
+	}
+
+	return xd;
+}
+
+static void
+xdev_handle_unlock(struct xdev *x)
+{
+
+	pthread_mutex_unlock(&x->handles.mutex);
+}
+
+/*
+ * Return the handle of the device's devname, registering xd if the name
+ * has none yet.  A device of an enumeration's arena is registered as a
+ * copy, so that the table does not hold on to the arena.  The handle
+ * goes stale once a monitor on the xdev sees an event for the devname,
+ * or it is released; the accessors then fail with ESTALE.  Without a
+ * monitor nothing notices a detach, and the table keeps every devname
+ * registered until then.
+ */
+int
+xdev_device_get_handle(struct xdev_device *xd, xdev_handle_t *hp)
+{
+	struct xdev *x;
+	int ret;
+
+	if (__predict_false(xd == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xd->magic != XDEV_DEVICE_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(hp == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	x = xd->xdev;
+	assert(x->magic == XDEV_MAGIC);
+
+	xd = xdev_device_copy(xd);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	pthread_mutex_lock(&x->handles.mutex);
+	ret = xdev_handle_table_insert(&x->handles, xd, hp);
+	pthread_mutex_unlock(&x->handles.mutex);
+
+	xdev_device_unref(xd);
+
+	return ret;
+}
+
+/*
+ * Drop h and its device before an event does, for callers without a
+ * monitor on x.  Every handle to the devname goes stale.
+ */
+int
+xdev_handle_release(struct xdev *x, xdev_handle_t h)
+{
+	struct xdev_device *xd;
+	void *v;
+
+	xd = xdev_handle_lock(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	v = xdev_hash_remove(&x->handles.index, xd->devname);
+	assert(v != NULL);
+	xd = xdev_handle_table_free(&x->handles, (uint32_t)((uintptr_t)v - 1));
+	xdev_handle_unlock(x);
+
+	xdev_device_unref(xd);
+
+	return 0;
+}
+
+struct xdev_device *
+xdev_handle_get_device(struct xdev *x, xdev_handle_t h)
+{
+	struct xdev_device *xd;
+
+	xd = xdev_handle_lock(x, h);
+	if (__predict_false(xd == NULL))
+		return NULL;
+
+	xdev_device_ref(xd);
+	xdev_handle_unlock(x);
+
+	return xd;
+}
+
+/*
+ * Device names are not interned, the device may go as soon as the
+ * lock is dropped: copy the name into buf while it is held.  Fails with
+ * ERANGE if it does not fit in len bytes.
+ */
+int
+xdev_handle_get_devname(struct xdev *x, xdev_handle_t h, char *buf,
+	size_t len)
+{
+	struct xdev_device *xd;
+
+	if (__predict_false(buf == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xd = xdev_handle_lock(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	if (__predict_false(strlcpy(buf, xd->devname, len) >= len)) {
+		xdev_handle_unlock(x);
+		errno = ERANGE;
+		return -1;
+	}
+	xdev_handle_unlock(x);
+
+	return 0;
+}
+
+int
+xdev_handle_get_driver(struct xdev *x, xdev_handle_t h, const char **driver)
+{
+	struct xdev_device *xd;
+	int ret;
+
+	/* May have to fetch the properties, do not hold the lock for it. */
+	xd = xdev_handle_get_device(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	ret = xdev_device_get_driver(xd, driver);
+	xdev_device_unref(xd);
+
+	return ret;
+}
+
+int
+xdev_handle_get_devclass(struct xdev *x, xdev_handle_t h,
+	const char **devclass)
+{
+	struct xdev_device *xd;
+	int ret;
+
+	xd = xdev_handle_get_device(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	ret = xdev_device_get_devclass(xd, devclass);
+	xdev_device_unref(xd);
+
+	return ret;
+}
+
+int
+xdev_handle_get_devsubclass(struct xdev *x, xdev_handle_t h,
+	const char **devsubclass)
+{
+	struct xdev_device *xd;
+	int ret;
+
+	xd = xdev_handle_get_device(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	ret = xdev_device_get_devsubclass(xd, devsubclass);
+	xdev_device_unref(xd);
+
+	return ret;
+}
+
+int
+xdev_handle_get_parent(struct xdev *x, xdev_handle_t h, const char **parent)
+{
+	struct xdev_device *xd;
+
+	xd = xdev_handle_lock(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	if (parent != NULL)
+		*parent = xd->parent;
+	xdev_handle_unlock(x);
+
+	return 0;
+}
+
+int
+xdev_handle_get_unit(struct xdev *x, xdev_handle_t h, uint32_t *unit)
+{
+	struct xdev_device *xd;
+	int ret;
+
+	xd = xdev_handle_get_device(x, h);
+	if (__predict_false(xd == NULL))
+		return -1;
+
+	ret = xdev_device_get_unit(xd, unit);
+	xdev_device_unref(xd);
+
+	return ret;
+}
@@ -0,0 +1,78 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_HANDLE_H_
+#define _XDEV_HANDLE_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "xdev.h"
+#include "xdev_hash.h"
+
+/*
+ * A handle is a slot index in the low XDEV_HANDLE_INDEX_BITS bits and
+ * the slot generation above them.  The generation is never 0, so no
+ * valid handle equals XDEV_HANDLE_INVALID.
+ */
+#define XDEV_HANDLE_INDEX_BITS	20
+#define XDEV_HANDLE_INDEX_MASK	((1U << XDEV_HANDLE_INDEX_BITS) - 1)
+#define XDEV_HANDLE_GEN_MASK	((1U << (32 - XDEV_HANDLE_INDEX_BITS)) - 1)
+
+struct xdev_handle_slot {
+	struct xdev_device *device;	/* NULL: free */
+	uint32_t generation;
+	uint32_t next_free;		/* index + 1, 0: end of list */
+};
+
+/*
+ * Dense table of devices handed out by handle, one slot per devname.
+ * A slot is freed, and its generation bumped, when an event for its
+ * devname comes in.
+ */
+struct xdev_handle_table {
+	pthread_mutex_t mutex;
+	struct xdev_handle_slot *slots;
+	uint32_t num_slots;		/* slots in use or on the free list */
+	uint32_t max_slots;		/* allocated */
+	uint32_t free_head;		/* index + 1, 0: empty */
+	struct xdev_hash index;		/* devname -> index + 1 */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_handle_table_init(struct xdev_handle_table *);
+void xdev_handle_table_fini(struct xdev_handle_table *);
+void xdev_handle_table_invalidate(struct xdev_handle_table *, const char *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_HANDLE_H_ */
@@ -0,0 +1,216 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_hash.h"
+#include "xdev_utils.h"
+
+#define XDEV_HASH_MIN_SLOTS 16
+
+const char xdev_hash_tombstone[1];
+
+static struct xdev_hash_entry *
+xdev_hash_find(const struct xdev_hash *h, const char *key, uint32_t hash)
+{
+	struct xdev_hash_entry *e;
+	size_t i;
+
+	for (i = hash & h->mask; (e = &h->entries[i])->key != NULL;
+	    i = (i + 1) & h->mask) {
+		if (e->key == xdev_hash_tombstone || e->hash != hash)
+			continue;
+		if (e->key == key || strcmp(e->key, key) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+static struct xdev_hash_entry *
+xdev_hash_slot(struct xdev_hash_entry *entries, size_t mask, uint32_t hash)
+{
+	size_t i;
+
+	for (i = hash & mask; entries[i].key != NULL &&
+	    entries[i].key != xdev_hash_tombstone; i = (i + 1) & mask)
+		continue;
+
+	return &entries[i];
+}
+
+static int
+xdev_hash_resize(struct xdev_hash *h, size_t slots)
+{
+	struct xdev_hash_entry *entries, *e, *n;
+	size_t i;
+
+	assert((slots & (slots - 1)) == 0);
+	assert(slots > h->count * 2);
+
+	entries = (struct xdev_hash_entry *)calloc(slots, sizeof(*entries));
+	if (__predict_false(entries == NULL))
+		return -1;
+
+	for (i = 0; h->entries != NULL && i <= h->mask; i++) {
+		e = &h->entries[i];
+		if (e->key == NULL || e->key == xdev_hash_tombstone)
+			continue;
+		n = xdev_hash_slot(entries, slots - 1, e->hash);
+		*n = *e;
+	}
+
+	free(h->entries);
+	h->entries = entries;
+	h->mask = slots - 1;
+	h->used = h->count;
+
+	return 0;
+}
+
+int
+xdev_hash_init(struct xdev_hash *h, size_t hint)
+{
+	size_t slots;
+
+	assert(h != NULL);
+
+	memset(h, 0, sizeof(*h));
+
+	for (slots = XDEV_HASH_MIN_SLOTS; slots < hint * 2; slots <<= 1)
+		continue;
+
+	return xdev_hash_resize(h, slots);
+}
+
+void
+xdev_hash_fini(struct xdev_hash *h)
+{
+
+	assert(h != NULL);
+
+	free(h->entries);
+	memset(h, 0, sizeof(*h));
+}
+
+void *
+xdev_hash_get(const struct xdev_hash *h, const char *key)
+{
+	struct xdev_hash_entry *e;
+
+	assert(h != NULL);
+	assert(h->entries != NULL);
+	assert(key != NULL);
+
+	e = xdev_hash_find(h, key, xstrhash(key));
+
+	return e != NULL ? e->value : NULL;
+}
+
+int
+xdev_hash_put(struct xdev_hash *h, const char *key, void *value)
+{
+	struct xdev_hash_entry *e;
+	uint32_t hash;
+	size_t slots;
+
+	assert(h != NULL);
+	assert(h->entries != NULL);
+	assert(key != NULL);
+
+	hash = xstrhash(key);
+	e = xdev_hash_find(h, key, hash);
+	if (e != NULL) {
+		e->key = key;
+		e->value = value;
+		return 0;
+	}
+
+	/* Keep the load factor, tombstones included, at or below 1/2. */
+	if ((h->used + 1) * 2 > h->mask + 1) {
+		for (slots = h->mask + 1; slots <= (h->count + 1) * 2;
+		    slots <<= 1)
+			continue;
+		if (__predict_false(xdev_hash_resize(h, slots) == -1))
+			return -1;
+	}
+
+	e = xdev_hash_slot(h->entries, h->mask, hash);
+	if (e->key == NULL)
+		h->used++;
+	e->key = key;
+	e->hash = hash;
+	e->value = value;
+	h->count++;
+
+	return 0;
+}
+
+void *
+xdev_hash_remove(struct xdev_hash *h, const char *key)
+{
+	struct xdev_hash_entry *e;
+	void *value;
+
+	assert(h != NULL);
+	assert(h->entries != NULL);
+	assert(key != NULL);
+
+	e = xdev_hash_find(h, key, xstrhash(key));
+	if (e == NULL)
+		return NULL;
+
+	value = e->value;
+	e->key = xdev_hash_tombstone;
+	e->value = NULL;
+	h->count--;
+
+	return value;
+}
+
+void
+xdev_hash_clear(struct xdev_hash *h)
+{
+
+	assert(h != NULL);
+	assert(h->entries != NULL);
+
+	memset(h->entries, 0, (h->mask + 1) * sizeof(h->entries[0]));
+	h->count = 0;
+	h->used = 0;
+}
@@ -0,0 +1,75 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_HASH_H_
+#define _XDEV_HASH_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <stdint.h>
+
+struct xdev_hash_entry {
+	const char *key;	/* NULL: free, xdev_hash_tombstone: deleted */
+	uint32_t hash;
+	void *value;
+};
+
+/*
+ * String-keyed open-addressing (linear probing) map.  Keys are not
+ * copied, they must stay valid for as long as they are in the map.
+ * No locking, callers serialize access.
+ */
+struct xdev_hash {
+	struct xdev_hash_entry *entries;
+	size_t mask;
+	size_t count;		/* live entries */
+	size_t used;		/* live entries and tombstones */
+};
+
+#define xdev_hash_foreach(e, h)						\
+	for ((e) = (h)->entries; (h)->entries != NULL &&		\
+	    (e) <= &(h)->entries[(h)->mask]; (e)++)			\
+		if ((e)->key == NULL || (e)->key == xdev_hash_tombstone) \
+			continue;					\
+		else
+
+__BEGIN_HIDDEN_DECLS
+extern const char xdev_hash_tombstone[];
+
+int xdev_hash_init(struct xdev_hash *, size_t);
+void xdev_hash_fini(struct xdev_hash *);
+void *xdev_hash_get(const struct xdev_hash *, const char *);
+int xdev_hash_put(struct xdev_hash *, const char *, void *);
+void *xdev_hash_remove(struct xdev_hash *, const char *);
+void xdev_hash_clear(struct xdev_hash *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_HASH_H_ */
@@ -0,0 +1,127 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_INLINE_H_
+#define _XDEV_INLINE_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <assert.h>
+
+#include <xdev.h>
+
+/*
+ * Unchecked accessors for hot loops, reading the device directly
+ * instead of calling xdev_device_get_*().  They skip the NULL check and
+ * only assert the magic, so a bad pointer is not caught under NDEBUG.
+ * Not for devices from a lazy enumeration: their driver, classes and
+ * unit stay unset until a getter fetches them.
+ *
+ * This is the leading part of the library's struct xdev_device, which
+ * checks at compile time that the two agree.
+ */
+#define XDEV_DEVICE_INLINE_MAGIC 0x8639fbc2
+
+struct xdev_device_head {
+	volatile unsigned int xdh_refcnt;
+	int xdh_magic;
+	struct xdev *xdh_xdev;
+	const char *xdh_devname;
+	const char *xdh_driver;
+	const char *xdh_devclass;
+	const char *xdh_devsubclass;
+	const char *xdh_event;
+	const char *xdh_parent;
+	char *xdh_xml;
+	uint32_t xdh_unit;
+};
+
+static __inline const struct xdev_device_head *
+xdev_device_head(const struct xdev_device *xd)
+{
+	const struct xdev_device_head *xdh;
+
+	xdh = (const struct xdev_device_head *)(const void *)xd;
+	assert(xdh->xdh_magic == XDEV_DEVICE_INLINE_MAGIC);
+
+	return xdh;
+}
+
+static __inline const char *
+xdev_device_devname(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_devname;
+}
+
+static __inline const char *
+xdev_device_driver(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_driver;
+}
+
+static __inline const char *
+xdev_device_devclass(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_devclass;
+}
+
+static __inline const char *
+xdev_device_devsubclass(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_devsubclass;
+}
+
+static __inline const char *
+xdev_device_event(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_event;
+}
+
+static __inline const char *
+xdev_device_parent(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_parent;
+}
+
+static __inline uint32_t
+xdev_device_unit(const struct xdev_device *xd)
+{
+
+	return xdev_device_head(xd)->xdh_unit;
+}
+
+#endif /* !_XDEV_INLINE_H_ */
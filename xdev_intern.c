@@ -0,0 +1,156 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_hash.h"
+#include "xdev_intern.h"
+
+#define XDEV_INTERN_CHUNK	4096
+#define XDEV_INTERN_HINT	128
+
+int
+xdev_intern_init(struct xdev_intern *xi)
+{
+	int error;
+
+	assert(xi != NULL);
+
+	memset(xi, 0, sizeof(*xi));
+
+	error = pthread_mutex_init(&xi->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(
+	    xdev_hash_init(&xi->table, XDEV_INTERN_HINT) == -1)) {
+		pthread_mutex_destroy(&xi->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+xdev_intern_fini(struct xdev_intern *xi)
+{
+	struct xdev_intern_chunk *xc;
+
+	assert(xi != NULL);
+
+	while ((xc = xi->chunks) != NULL) {
+		xi->chunks = xc->next;
+		free(xc);
+	}
+
+	xdev_hash_fini(&xi->table);
+	pthread_mutex_destroy(&xi->mutex);
+}
+
+static char *
+xdev_intern_alloc(struct xdev_intern *xi, size_t len)
+{
+	struct xdev_intern_chunk *xc;
+	size_t size;
+
+	xc = xi->chunks;
+	if (xc != NULL && xc->size - xc->used >= len)
+		goto out;
+
+	size = MAX(len, XDEV_INTERN_CHUNK);
+	xc = (struct xdev_intern_chunk *)malloc(sizeof(*xc) + size);
+	if (__predict_false(xc == NULL))
+		return NULL;
+
+	xc->size = size;
+	xc->used = 0;
+
+	/* Oversized strings must not retire the current chunk. */
+	if (size > XDEV_INTERN_CHUNK && xi->chunks != NULL) {
+		xc->next = xi->chunks->next;
+		xi->chunks->next = xc;
+	} else {
+		xc->next = xi->chunks;
+		xi->chunks = xc;
+	}
+
+out:
+	xc->used += len;
+	return &xc->data[xc->used - len];
+}
+
+/*
+ * Return the interned copy of s.  Only the first sighting of a string
+ * allocates; later calls are a hash lookup.
+ */
+const char *
+xdev_intern_string(struct xdev_intern *xi, const char *s)
+{
+	const char *is;
+	size_t len;
+	char *p;
+
+	assert(xi != NULL);
+	assert(s != NULL);
+
+	pthread_mutex_lock(&xi->mutex);
+
+	is = (const char *)xdev_hash_get(&xi->table, s);
+	if (__predict_false(is == NULL)) {
+		len = strlen(s) + 1;
+		p = xdev_intern_alloc(xi, len);
+		if (__predict_true(p != NULL)) {
+			memcpy(p, s, len);
+			/* On failure the copy stays unused in its chunk. */
+			if (__predict_true(
+			    xdev_hash_put(&xi->table, p, p) == 0))
+				is = p;
+		}
+	}
+
+	pthread_mutex_unlock(&xi->mutex);
+
+	if (__predict_false(is == NULL))
+		errno = ENOMEM;
+
+	return is;
+}
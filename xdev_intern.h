@@ -0,0 +1,65 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_INTERN_H_
+#define _XDEV_INTERN_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include "xdev_hash.h"
+
+struct xdev_intern_chunk {
+	struct xdev_intern_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/*
+ * Table of immutable strings shared by all devices of an xdev.  Strings
+ * are packed into chunks and live until the table is destroyed, so the
+ * table only grows with the number of distinct names seen.
+ */
+struct xdev_intern {
+	pthread_mutex_t mutex;
+	struct xdev_hash table;		/* string -> itself */
+	struct xdev_intern_chunk *chunks;	/* current chunk first */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_intern_init(struct xdev_intern *);
+void xdev_intern_fini(struct xdev_intern *);
+const char *xdev_intern_string(struct xdev_intern *, const char *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_INTERN_H_ */
@@ -0,0 +1,193 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_journal.h"
+
+int
+xdev_journal_init(struct xdev_journal *j)
+{
+	int error;
+
+	assert(j != NULL);
+
+	memset(j, 0, sizeof(*j));
+
+	error = pthread_mutex_init(&j->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+xdev_journal_clear(struct xdev_journal *j)
+{
+	size_t i;
+
+	for (i = 0; i < j->count; i++)
+		prop_object_release(j->ring[i].ev);
+	j->count = 0;
+	j->head = 0;
+}
+
+void
+xdev_journal_fini(struct xdev_journal *j)
+{
+
+	assert(j != NULL);
+
+	xdev_journal_clear(j);
+	free(j->ring);
+	pthread_mutex_destroy(&j->mutex);
+}
+
+/*
+ * Resize the ring to size events, 0 disables it.  The events journaled
+ * so far are dropped.
+ */
+int
+xdev_journal_setup(struct xdev_journal *j, size_t size)
+{
+	struct xdev_journal_entry *ring;
+
+	assert(j != NULL);
+
+	ring = NULL;
+	if (size > 0) {
+		ring = (struct xdev_journal_entry *)calloc(size,
+			sizeof(*ring));
+		if (__predict_false(ring == NULL))
+			return -1;
+	}
+
+	pthread_mutex_lock(&j->mutex);
+	xdev_journal_clear(j);
+	free(j->ring);
+	j->ring = ring;
+	j->size = size;
+	pthread_mutex_unlock(&j->mutex);
+
+	return 0;
+}
+
+/* Assign the next sequence number to ev and keep it, if enabled. */
+uint64_t
+xdev_journal_append(struct xdev_journal *j, prop_dictionary_t ev)
+{
+	struct xdev_journal_entry *je;
+	prop_dictionary_t old;
+	uint64_t seq;
+
+	assert(j != NULL);
+	assert(ev != NULL);
+
+	old = NULL;
+
+	pthread_mutex_lock(&j->mutex);
+	seq = ++j->seq;
+	if (j->size > 0) {
+		je = &j->ring[j->head];
+		if (j->count == j->size)
+			old = je->ev;
+		else
+			j->count++;
+		prop_object_retain(ev);
+		je->ev = ev;
+		je->seq = seq;
+		j->head = (j->head + 1) % j->size;
+	}
+	pthread_mutex_unlock(&j->mutex);
+
+	if (old != NULL)
+		prop_object_release(old);
+
+	return seq;
+}
+
+/*
+ * Copy out the events following seq, oldest first, with the
+ * dictionaries retained.  Fails with ESTALE if some of them are no
+ * longer in the ring.
+ */
+ssize_t
+xdev_journal_since(struct xdev_journal *j, uint64_t seq,
+	struct xdev_journal_entry **out)
+{
+	struct xdev_journal_entry *entries;
+	size_t i, n, first;
+
+	assert(j != NULL);
+	assert(out != NULL);
+
+	pthread_mutex_lock(&j->mutex);
+
+	if (seq >= j->seq) {
+		pthread_mutex_unlock(&j->mutex);
+		*out = NULL;
+		return 0;
+	}
+
+	n = j->seq - seq;
+	if (__predict_false(n > j->count)) {
+		pthread_mutex_unlock(&j->mutex);
+		errno = ESTALE;
+		return -1;
+	}
+
+	entries = (struct xdev_journal_entry *)calloc(n, sizeof(*entries));
+	if (__predict_false(entries == NULL)) {
+		pthread_mutex_unlock(&j->mutex);
+		return -1;
+	}
+
+	first = (j->head + j->size - n) % j->size;
+	for (i = 0; i < n; i++) {
+		entries[i] = j->ring[(first + i) % j->size];
+		prop_object_retain(entries[i].ev);
+	}
+
+	pthread_mutex_unlock(&j->mutex);
+
+	*out = entries;
+	return (ssize_t)n;
+}
@@ -0,0 +1,69 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_JOURNAL_H_
+#define _XDEV_JOURNAL_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <prop/proplib.h>
+#include <pthread.h>
+#include <stdint.h>
+
+struct xdev_journal_entry {
+	uint64_t seq;
+	prop_dictionary_t ev;		/* retained */
+};
+
+/*
+ * Ring of the most recent events seen by the monitors of an xdev, for
+ * consumers catching up.  Sequence numbers are assigned even while the
+ * ring is disabled (size 0); the first event gets 1.
+ */
+struct xdev_journal {
+	pthread_mutex_t mutex;
+	struct xdev_journal_entry *ring;
+	size_t size;
+	size_t count;
+	size_t head;			/* next slot to fill */
+	uint64_t seq;			/* last assigned */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_journal_init(struct xdev_journal *);
+void xdev_journal_fini(struct xdev_journal *);
+int xdev_journal_setup(struct xdev_journal *, size_t);
+uint64_t xdev_journal_append(struct xdev_journal *, prop_dictionary_t);
+ssize_t xdev_journal_since(struct xdev_journal *, uint64_t,
+	struct xdev_journal_entry **);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_JOURNAL_H_ */
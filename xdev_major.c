@@ -0,0 +1,159 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_major.h"
+#include "xdev_utils.h"
+
+static const struct kinfo_drivers xdev_majors_none = {
+	.d_cmajor = NODEVMAJOR,
+	.d_bmajor = NODEVMAJOR,
+};
+
+int
+xdev_majors_init(struct xdev_majors *xmj)
+{
+	int error;
+
+	assert(xmj != NULL);
+
+	memset(xmj, 0, sizeof(*xmj));
+
+	error = pthread_mutex_init(&xmj->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&xmj->bydriver, 0) == -1)) {
+		pthread_mutex_destroy(&xmj->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+xdev_majors_fini(struct xdev_majors *xmj)
+{
+
+	assert(xmj != NULL);
+
+	xdev_hash_fini(&xmj->bydriver);
+	free(xmj->kid);
+	pthread_mutex_destroy(&xmj->mutex);
+}
+
+void
+xdev_majors_invalidate(struct xdev_majors *xmj)
+{
+
+	assert(xmj != NULL);
+
+	pthread_mutex_lock(&xmj->mutex);
+	xdev_hash_clear(&xmj->bydriver);
+	free(xmj->kid);
+	xmj->kid = NULL;
+	xmj->cnt = 0;
+	pthread_mutex_unlock(&xmj->mutex);
+}
+
+static int
+xdev_majors_load(struct xdev_majors *xmj)
+{
+	size_t i;
+
+	xmj->kid = kinfo_getdrivers(&xmj->cnt);
+	if (__predict_false(xmj->kid == NULL))
+		return -1;
+
+	for (i = 0; i < xmj->cnt; i++) {
+		if (__predict_false(xdev_hash_put(&xmj->bydriver,
+		    xmj->kid[i].d_name, &xmj->kid[i]) == -1)) {
+			xdev_hash_clear(&xmj->bydriver);
+			free(xmj->kid);
+			xmj->kid = NULL;
+			xmj->cnt = 0;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Look up the majors of driver, which has to stay valid as long as xmj
+ * (an interned name).  NODEVMAJOR for the ones it does not have.
+ */
+int
+xdev_majors_lookup(struct xdev_majors *xmj, const char *driver,
+	devmajor_t *cmajor, devmajor_t *bmajor)
+{
+	const struct kinfo_drivers *k;
+
+	assert(xmj != NULL);
+	assert(driver != NULL);
+
+	pthread_mutex_lock(&xmj->mutex);
+
+	if (xmj->kid == NULL &&
+	    __predict_false(xdev_majors_load(xmj) == -1)) {
+		pthread_mutex_unlock(&xmj->mutex);
+		return -1;
+	}
+
+	k = (const struct kinfo_drivers *)xdev_hash_get(&xmj->bydriver,
+		driver);
+	if (k == NULL) {
+		k = &xdev_majors_none;
+		/* If this fails the next lookup just misses again. */
+		xdev_hash_put(&xmj->bydriver, driver, __UNCONST(k));
+	}
+
+	if (cmajor != NULL)
+		*cmajor = k->d_cmajor;
+	if (bmajor != NULL)
+		*bmajor = k->d_bmajor;
+
+	pthread_mutex_unlock(&xmj->mutex);
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_MAJOR_H_
+#define _XDEV_MAJOR_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include "xdev_hash.h"
+
+/*
+ * Character and block majors by driver name, from one kern.drivers
+ * sysctl instead of one per getdevmajor(3) call.  Drivers without
+ * majors are remembered as such until invalidated, which a device
+ * attaching does (a module may have brought new majors).
+ */
+struct xdev_majors {
+	pthread_mutex_t mutex;
+	struct kinfo_drivers *kid;	/* NULL until needed */
+	size_t cnt;
+	struct xdev_hash bydriver;	/* name -> kid entry or none */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_majors_init(struct xdev_majors *);
+void xdev_majors_fini(struct xdev_majors *);
+void xdev_majors_invalidate(struct xdev_majors *);
+int xdev_majors_lookup(struct xdev_majors *, const char *, devmajor_t *,
+	devmajor_t *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_MAJOR_H_ */
@@ -37,22 +37,97 @@ __RCSID("$NetBSD$");
 
 #include <assert.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_class.h"
 #include "xdev_device.h"
+#include "xdev_enumerate.h"
+#include "xdev_hash.h"
+#include "xdev_intern.h"
+#include "xdev_journal.h"
 #include "xdev_monitor.h"
 #include "xdev_list.h"
+#include "xdev_pool.h"
 #include "xdev_private.h"
+#include "xdev_ring.h"
 #include "xdev_utils.h"
+#include "xdev_watch.h"
+#include "xdev_worker.h"
 
 const static uint8_t one = '1';
 
+/* The members outlive their devices, so the names are copied. */
+static int
+xdev_monitor_add_member(struct xdev_monitor *xm, const char *devname)
+{
+	char *name;
+
+	name = strdup(devname);
+	if (__predict_false(name == NULL))
+		return -1;
+
+	if (__predict_false(xdev_hash_put(&xm->members, name, name) == -1)) {
+		free(name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+xdev_monitor_free_members(struct xdev_monitor *xm)
+{
+	struct xdev_hash_entry *e;
+
+	xdev_hash_foreach(e, &xm->members)
+		free(e->value);
+	xdev_hash_fini(&xm->members);
+}
+
+static int
+xdev_monitor_drvctl_recv(void *cookie, prop_dictionary_t *evp)
+{
+	struct xdev *x;
+	int ret;
+
+	x = (struct xdev *)cookie;
+
+	/* non-blocking read */
+	ret = prop_dictionary_recv_ioctl(x->drvctl_fd, DRVGETEVENT, evp);
+	if (__predict_false(ret != 0)) {
+		errno = ret;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+xdev_monitor_ring_recv(void *cookie, prop_dictionary_t *evp)
+{
+	struct xdev_monitor *xm;
+	int ret;
+
+	xm = (struct xdev_monitor *)cookie;
+
+	ret = xdev_ring_get(xm->ring, evp);
+
+	if (__predict_false(xm->ring->lost != xm->lost)) {
+		pthread_mutex_lock(&xm->mutex);
+		xm->lost = xm->ring->lost;
+		pthread_mutex_unlock(&xm->mutex);
+	}
+
+	return ret;
+}
+
 struct xdev_monitor *
 xdev_monitor_new(struct xdev *x)
 {
@@ -72,30 +147,40 @@ xdev_monitor_new(struct xdev *x)
 	if (__predict_false(xm == NULL))
 		return NULL;
 
-	if (__predict_false(
-		pipe2(xm->shutdown_fd, O_CLOEXEC | O_NONBLOCK) == -1))
+	if (__predict_false(xdev_workers_get_pipe(&x->workers,
+	    xm->queues[0].pipe_fd) == -1))
 		goto fail;
 
-	if (__predict_false(pipe2(xm->pipe_fd, O_CLOEXEC | O_NONBLOCK) == -1))
+	if (__predict_false(pthread_mutex_init(&xm->mutex, NULL) != 0))
 		goto fail2;
 
-	if (__predict_false(pthread_mutex_init(&xm->mutex, NULL) != 0))
+	xm->pool = xdev_pool_new(XDEV_MONITOR_POOL_SIZE);
+	if (__predict_false(xm->pool == NULL))
 		goto fail3;
 
+	if (__predict_false(xdev_watches_init(&xm->watches) == -1))
+		goto fail4;
+
 	xm->refcnt = 1;
 	xm->magic = XDEV_MONITOR_MAGIC;
 	xm->xdev = x;
-	TAILQ_INIT(&xm->devices);
+	xm->source.xs_fd = x->drvctl_fd;
+	xm->source.xs_interval = INFTIM;
+	xm->source.xs_recv = xdev_monitor_drvctl_recv;
+	xm->source.xs_cookie = x;
+	TAILQ_INIT(&xm->queues[0].devices);
+	xm->num_queues = 1;
 
 	return xm;
 
+fail4:
+	xdev_pool_release(xm->pool);
+
 fail3:
-	xclose(xm->pipe_fd[0]);
-	xclose(xm->pipe_fd[1]);
+	pthread_mutex_destroy(&xm->mutex);
 
 fail2:
-	xclose(xm->shutdown_fd[0]);
-	xclose(xm->shutdown_fd[1]);
+	xdev_workers_put_pipe(&x->workers, xm->queues[0].pipe_fd);
 
 fail:
 	free(xm);
@@ -125,6 +210,8 @@ xdev_monitor_ref(struct xdev_monitor *xm)
 struct xdev_monitor *
 xdev_monitor_unref(struct xdev_monitor *xm)
 {
+	struct xdev_workers *ws;
+	int i;
 
 	if (__predict_false(xm == NULL)) {
 		errno = EINVAL;
@@ -137,15 +224,20 @@ xdev_monitor_unref(struct xdev_monitor *xm)
 	}
 
 	if (xm->refcnt == 1) {
-		if (xm->thread != NULL) {
-			xwrite(xm->shutdown_fd[1], &one, 1);
-			pthread_join(xm->thread, NULL);
+		ws = &xm->xdev->workers;
+		if (xm->worker != NULL)
+			xdev_workers_stop(ws, xm->worker);
+		for (i = 0; i < xm->num_queues; i++) {
+			xdev_workers_put_pipe(ws, xm->queues[i].pipe_fd);
+			xdev_list_free(&xm->queues[i].devices);
+		}
+		if (xm->ring != NULL) {
+			xdev_ring_close(xm->ring);
+			free(xm->ring);
 		}
-		xclose(xm->shutdown_fd[0]);
-		xclose(xm->shutdown_fd[1]);
-		xclose(xm->pipe_fd[0]);
-		xclose(xm->pipe_fd[1]);
-		xdev_list_free(&xm->devices);
+		xdev_watches_fini(&xm->watches);
+		xdev_monitor_free_members(xm);
+		xdev_pool_release(xm->pool);
 		pthread_mutex_destroy(&xm->mutex);
 		xm->magic = 0xdeadbeef;
 		free(xm);
@@ -195,49 +287,493 @@ xdev_monitor_filter(struct xdev_monitor *xm, xdev_filter_cb xfcb,
 	return 0;
 }
 
-static void *
-xdev_monitor_thread(void *arg)
+/*
+ * Only pass on events of root and the devices below it, or of all
+ * devices again if root is NULL or "".  Applied before the filter.
+ */
+int
+xdev_monitor_filter_subtree(struct xdev_monitor *xm, const char *root)
 {
-	struct xdev_monitor *xm;
+	const char *r;
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	r = NULL;
+	if (root != NULL && root[0] != '\0') {
+		r = xdev_intern_string(&xm->xdev->intern, root);
+		if (__predict_false(r == NULL))
+			return -1;
+	}
+
+	xm->subtree = r;
+
+	return 0;
+}
+
+/*
+ * In nocopy mode the event dictionary is handed over to the device
+ * as is and the XML is only built if xdev_device_externalize() is
+ * called.
+ */
+int
+xdev_monitor_set_nocopy(struct xdev_monitor *xm, bool nocopy)
+{
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xm->nocopy = nocopy;
+
+	return 0;
+}
+
+/*
+ * Stamp received devices with the time of each stage, for
+ * xdev_device_get_timestamp().  Costs three clock_gettime(2) calls per
+ * event.
+ */
+int
+xdev_monitor_set_timestamps(struct xdev_monitor *xm, bool timestamps)
+{
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	xm->timestamps = timestamps;
+
+	return 0;
+}
+
+/*
+ * Replace drvctl(4) as the origin of events.  xs_recv() either returns
+ * 0 and a dictionary with the event, device and parent strings, which
+ * the monitor takes over, or -1 and EAGAIN if there is nothing to read
+ * yet; any other error stops the monitor.  xs_fd is polled for input
+ * before reading, a source without a descriptor (-1) is polled every
+ * xs_interval milliseconds.  Must be called before receiving is enabled.
+ */
+int
+xdev_monitor_set_source(struct xdev_monitor *xm, const struct xdev_source *xs)
+{
+
+	if (__predict_false(xm == NULL || xs == NULL || xs->xs_recv == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xs->xs_fd == -1 && xs->xs_interval < 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->worker != NULL)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	xm->source = *xs;
+
+	return 0;
+}
+
+/*
+ * Read the events published by xdevd(8) at path, or XDEV_RING_PATH if
+ * NULL, instead of asking drvctl(4).  This needs no write access to
+ * /dev/drvctl, and every attached monitor sees every event.  Must be
+ * called before receiving is enabled.  Events the broker overwrote
+ * before they were read are counted, see xdev_monitor_get_lost().
+ */
+int
+xdev_monitor_attach_ring(struct xdev_monitor *xm, const char *path)
+{
+	struct xdev_source xs;
+	struct xdev_ring *r;
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->worker != NULL || xm->ring != NULL)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	r = (struct xdev_ring *)calloc(sizeof(*r), 1);
+	if (__predict_false(r == NULL))
+		return -1;
+
+	if (__predict_false(xdev_ring_open(r,
+	    path != NULL ? path : XDEV_RING_PATH) == -1)) {
+		free(r);
+		return -1;
+	}
+
+	xs.xs_fd = -1;
+	xs.xs_interval = XDEV_MONITOR_RING_INTERVAL;
+	xs.xs_recv = xdev_monitor_ring_recv;
+	xs.xs_cookie = xm;
+
+	xm->source = xs;
+	xm->ring = r;
+
+	return 0;
+}
+
+/*
+ * Re-read the properties of watched devices every interval ms, at most
+ * batch of them at a time, and queue a "device-change" event for each
+ * device whose properties differ from the previous read.  Comparing
+ * costs one fingerprint per device.  Polls run on the monitor thread
+ * while the source has no events pending, a few ms at a time.  0 stops
+ * watching.  Must be called before receiving is enabled.
+ */
+int
+xdev_monitor_set_watch(struct xdev_monitor *xm, unsigned int interval,
+	unsigned int batch)
+{
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->worker != NULL)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	return xdev_watches_setup(&xm->watches, interval, batch);
+}
+
+int
+xdev_monitor_add_watch(struct xdev_monitor *xm, const char *devname)
+{
+
+	if (__predict_false(xm == NULL || devname == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_watches_add(&xm->watches, xm->xdev, devname);
+}
+
+int
+xdev_monitor_remove_watch(struct xdev_monitor *xm, const char *devname)
+{
+
+	if (__predict_false(xm == NULL || devname == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xdev_watches_remove(&xm->watches, devname);
+}
+
+/*
+ * Decide whether an event changes what the consumer knows: attaches of
+ * present and detaches of absent devices are dropped.  Called with the
+ * mutex held once tracking.
+ */
+static bool
+xdev_monitor_track(struct xdev_monitor *xm, struct xdev_device *xd)
+{
+	bool present;
+
+	present = xdev_hash_get(&xm->members, xd->devname) != NULL;
+
+	if (xd->event == xm->attach) {
+		if (present)
+			return false;
+		/* If this fails a later duplicate slips through. */
+		xdev_monitor_add_member(xm, xd->devname);
+	} else if (xd->event == xm->detach) {
+		if (!present)
+			return false;
+		free(xdev_hash_remove(&xm->members, xd->devname));
+	}
+
+	return true;
+}
+
+static bool
+xdev_monitor_parse(prop_dictionary_t ev, const char **event,
+	const char **device, const char **parent)
+{
+
+	return prop_dictionary_get_cstring_nocopy(ev, "event", event) &&
+	    prop_dictionary_get_cstring_nocopy(ev, "device", device) &&
+	    prop_dictionary_get_cstring_nocopy(ev, "parent", parent);
+}
+
+/*
+ * Turn an event into a device and queue it, taking over ev.  read_ts
+ * is when the event was read, if known.  Returns 1 if queued, 0 if dropped
+ * and -1 if there was no memory to queue it.
+ */
+static int
+xdev_monitor_dispatch(struct xdev_monitor *xm, prop_dictionary_t ev,
+	const char *event, const char *device, const char *parent,
+	uint64_t seq, const struct timespec *read_ts, bool replayed)
+{
+	struct xdev_monitor_queue *xq, *q;
+	struct xdev_list_entry *xle, *pos;
 	struct xdev_device *xd;
 	struct xdev *x;
-	struct xdev_list_entry *xle;
+#ifdef XDEV_TRACE
+	char devname[XDEV_DEVICE_NAME_SIZE];
+#endif
+	const char *devclass;
+	const char *devsubclass;
+	char *xml;
+	bool dup;
+	int i;
+
+	x = xm->xdev;
+
+	xdev_class_lookup_devname(device, &devclass, &devsubclass);
+
+	if (xm->nocopy) {
+		xd = xdev_device_new_nocopy(x, xm->pool, ev, device,
+			"???", devclass, devsubclass, event, parent, -1);
+		prop_object_release(ev);
+	} else {
+		xml = prop_dictionary_externalize(ev);
+		if (__predict_false(xml == NULL)) {
+			prop_object_release(ev);
+			return 0;
+		}
+
+		xd = xdev_device_new(x, xm->pool, device, "???",
+			devclass, devsubclass, event, parent, xml, -1, ev);
+		free(xml);
+		prop_object_release(ev);
+	}
+
+	if (__predict_false(xd == NULL))
+		return 0;
+
+	xd->seq = seq;
+
+	if (xm->subtree != NULL && xdev_ancestry_is_below(&x->ancestry,
+	    xd->devname, xd->parent, xm->subtree) != 1) {
+		xdev_device_unref(xd);
+		return 0;
+	}
+
+	if (xm->xfcb && xm->xfcb(xd, xm->xfcb_cookie) != 0) {
+		xdev_device_unref(xd);
+		return 0;
+	}
+
+#ifdef XDEV_TRACE
+	/* The device may be gone once queued. */
+	strlcpy(devname, xd->devname, sizeof(devname));
+#endif
+
+	XDEV_TRACEPOINT(x, XDEV_TRACE_FILTER, devname, seq);
+
+	xq = &xm->queues[0];
+	for (i = 0; i < xm->num_queues - 1; i++) {
+		q = &xm->queues[xm->order[i]];
+		if ((*q->match)(xd, q->match_cookie) == 0) {
+			xq = q;
+			break;
+		}
+	}
+
+	xle = xdev_pool_get_entry(xm->pool, xd);
+	if (__predict_false(xle == NULL)) {
+		xdev_device_unref(xd);
+		return -1;
+	}
+
+	if (xm->timestamps) {
+		if (read_ts != NULL)
+			xd->stamps[XDEV_STAMP_READ] = *read_ts;
+		clock_gettime(CLOCK_MONOTONIC, &xd->stamps[XDEV_STAMP_QUEUE]);
+	}
+
+	/*
+	 * One byte in the pipe per queued entry.  A live event that
+	 * xdev_monitor_replay() got to first is not queued twice, nor is a
+	 * replayed one still waiting in its queue.  Replayed events go in
+	 * sequence order, live ones come in it.
+	 */
+	pthread_mutex_lock(&xm->mutex);
+	pos = NULL;
+	if (!replayed) {
+		dup = seq <= xm->last_seq;
+	} else {
+		dup = false;
+		TAILQ_FOREACH_REVERSE(pos, &xq->devices, xdev_list, link) {
+			if (pos->device->seq <= seq) {
+				dup = pos->device->seq == seq;
+				break;
+			}
+		}
+	}
+	if (dup || (xm->tracking && !xdev_monitor_track(xm, xd))) {
+		pthread_mutex_unlock(&xm->mutex);
+		xdev_device_unref(xd);
+		xdev_pool_put_entry(xm->pool, xle);
+		return 0;
+	}
+	if (!replayed)
+		TAILQ_INSERT_TAIL(&xq->devices, xle, link);
+	else if (pos != NULL)
+		TAILQ_INSERT_AFTER(&xq->devices, pos, xle, link);
+	else
+		TAILQ_INSERT_HEAD(&xq->devices, xle, link);
+	if (__predict_false(xwrite(xq->pipe_fd[1], &one, 1) != 1)) {
+		TAILQ_REMOVE(&xq->devices, xle, link);
+		pthread_mutex_unlock(&xm->mutex);
+		xdev_device_unref(xd);
+		xdev_pool_put_entry(xm->pool, xle);
+		return 0;
+	}
+	if (seq > xm->last_seq)
+		xm->last_seq = seq;
+	pthread_mutex_unlock(&xm->mutex);
+
+	XDEV_TRACEPOINT(x, XDEV_TRACE_QUEUE, devname, seq);
+
+	return 1;
+}
+
+/*
+ * Queue a change event for a watched device, like one read from the
+ * source.
+ */
+static void
+xdev_monitor_change(struct xdev_device *xd, void *cookie)
+{
+	struct xdev_monitor *xm;
+	prop_dictionary_t ev;
+	struct timespec read_ts, *rts;
+	uint64_t seq;
+
+	xm = (struct xdev_monitor *)cookie;
+
+	ev = prop_dictionary_create();
+	if (__predict_false(ev == NULL))
+		return;
+
+	if (__predict_false(
+	    !prop_dictionary_set_cstring(ev, "event", "device-change") ||
+	    !prop_dictionary_set_cstring(ev, "device", xd->devname) ||
+	    !prop_dictionary_set_cstring(ev, "parent", xd->parent))) {
+		prop_object_release(ev);
+		return;
+	}
+
+	rts = NULL;
+	if (xm->timestamps) {
+		clock_gettime(CLOCK_MONOTONIC, &read_ts);
+		rts = &read_ts;
+	}
+
+	seq = xdev_notify_event(xm->xdev, ev, "device-change", xd->devname,
+		xd->parent);
+
+	XDEV_TRACEPOINT(xm->xdev, XDEV_TRACE_READ, xd->devname, seq);
+
+	/* If there is no memory the change is lost, as an event would be. */
+	xdev_monitor_dispatch(xm, ev, "device-change", xd->devname,
+		xd->parent, seq, rts, false);
+}
+
+/*
+ * Runs on a worker thread until wake_fd becomes readable.
+ */
+static void
+xdev_monitor_run(void *arg, int wake_fd)
+{
+	struct xdev_monitor *xm;
+	struct xdev *x;
 	prop_dictionary_t ev;
 	struct pollfd pfd[2];
 	int num_fds;
-	int drvctl_fd;
-	int pipe_end;
+	int timeout;
 	int ret;
 	const char *event;
 	const char *device;
 	const char *parent;
-	char *xml;
-	bool b;
+	struct timespec read_ts, *rts;
+	uint64_t seq;
 
 	assert(arg != NULL);
 
 	xm = (struct xdev_monitor *)arg;
 	x = xm->xdev;
-	drvctl_fd = xm->xdev->drvctl_fd;
-	pipe_end = xm->pipe_fd[1];
 
-	pfd[0].fd = drvctl_fd;
+	pfd[0].fd = xm->source.xs_fd;
 	pfd[0].events = POLLIN;
 
-	pfd[1].fd = xm->shutdown_fd[0];
+	pfd[1].fd = wake_fd;
 	pfd[1].events = POLLIN;
 
+	timeout = xm->source.xs_fd == -1 ? xm->source.xs_interval : INFTIM;
+
 	assert(xm->magic == XDEV_MONITOR_MAGIC);
 	assert(x != NULL);
 	assert(x->magic == XDEV_MAGIC);
 
 	for (;;) {
-		num_fds = xpoll(pfd, __arraycount(pfd), INFTIM);
+		num_fds = xpoll(pfd, __arraycount(pfd),
+			xdev_watches_timeout(&xm->watches, timeout));
 		if (__predict_false(num_fds == -1)) {
 			break;
 		}
 
-		/* drvctl device error */
+		/* source device error */
 		if (__predict_false(pfd[0].revents & (POLLERR|POLLNVAL))) {
 			break;
 		}
@@ -247,13 +783,13 @@ xdev_monitor_thread(void *arg)
 			break;
 		}
 
-		/* drvctl device HUP */
+		/* source device HUP */
 		if (__predict_false(pfd[0].revents & POLLHUP)) {
 			break;
 		}
 
 		/* self-pipe HUP */
-		if (__predict_false(pfd[0].revents & POLLHUP)) {
+		if (__predict_false(pfd[1].revents & POLLHUP)) {
 			break;
 		}
 
@@ -262,84 +798,284 @@ xdev_monitor_thread(void *arg)
 			break;
 		}
 
-		/* drvctl is ready to deliver a message */
-		if (pfd[0].revents & POLLIN) {
+		/*
+		 * Watched devices are polled while the source is idle, so
+		 * that a backlog of events is not held up by them.
+		 */
+		if (pfd[0].fd == -1 ? timeout != 0 :
+		    (pfd[0].revents & POLLIN) == 0)
+			xdev_watches_poll(&xm->watches, x, xdev_monitor_change,
+				xm);
+
+		/* the source is ready to deliver a message */
+		if (pfd[0].fd == -1 || (pfd[0].revents & POLLIN)) {
 			__nothing;
 		} else {
-			/* Can we ever land here? */
+			/* Woken up for the watched devices only. */
 			continue;
 		}
 
-		/* non-blocking read */
-		ret = prop_dictionary_recv_ioctl(drvctl_fd, DRVGETEVENT, &ev);
+		ret = (*xm->source.xs_recv)(xm->source.xs_cookie, &ev);
 		if (__predict_false(ret != 0)) {
+			if (errno == EAGAIN) {
+				if (pfd[0].fd == -1)
+					timeout = xm->source.xs_interval;
+				continue;
+			}
 			break;
 		}
 
-		b = prop_dictionary_get_cstring_nocopy(ev, "event", &event);
-		if (__predict_false(b == false)) {
-			prop_object_release(ev);
-			continue;
+		rts = NULL;
+		if (xm->timestamps) {
+			clock_gettime(CLOCK_MONOTONIC, &read_ts);
+			rts = &read_ts;
 		}
 
-		b = prop_dictionary_get_cstring_nocopy(ev, "device", &device);
-		if (__predict_false(b == false)) {
-			prop_object_release(ev);
-			continue;
-		}
+		/* Sources without a descriptor are read until drained. */
+		if (pfd[0].fd == -1)
+			timeout = 0;
 
-		b = prop_dictionary_get_cstring_nocopy(ev, "parent", &parent);
-		if (__predict_false(b == false)) {
+		if (__predict_false(!xdev_monitor_parse(ev, &event, &device,
+		    &parent))) {
 			prop_object_release(ev);
 			continue;
 		}
 
-		xml = prop_dictionary_externalize(ev);
-		if (__predict_false(xml == NULL)) {
-			prop_object_release(ev);
-			continue;
-		}
+		seq = xdev_notify_event(x, ev, event, device, parent);
 
-		xd = xdev_device_new(x, device, "???", "???", "???", event,
-			parent, xml, -1);
-		free(xml);
-		prop_object_release(ev);
+		XDEV_TRACEPOINT(x, XDEV_TRACE_READ, device, seq);
 
-		if (__predict_false(xd == NULL))
-			continue;
+		if (__predict_false(xdev_monitor_dispatch(xm, ev, event, device,
+		    parent, seq, rts, false) == -1))
+			break;
+	}
+}
 
-		if (xm->xfcb && xm->xfcb(xd, xm->xfcb_cookie) != 0) {
-			xdev_device_unref(xd);
-			continue;
+int
+xdev_monitor_enable_receiving(struct xdev_monitor *xm)
+{
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->worker != NULL)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	xm->worker = xdev_workers_start(&xm->xdev->workers, xdev_monitor_run,
+		xm);
+	if (__predict_false(xm->worker == NULL))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Start receiving, if not done yet, and take a snapshot of the devices
+ * below root_devname with xe.  From then on the monitor only passes on
+ * events that are news relative to the snapshot: the events queued
+ * while scanning are replayed against it, attaches of devices already
+ * seen and detaches of devices never seen are dropped, now and later.
+ * xe and the monitor should use the same filter.  Returns the number
+ * of devices in the snapshot.
+ */
+int
+xdev_monitor_scan_devices(struct xdev_monitor *xm, struct xdev_enumerate *xe,
+	const char *root_devname, int max_depth)
+{
+	struct xdev_monitor_queue *xq;
+	struct xdev_list_entry *xle, *next;
+	struct xdev_device *xd;
+	struct xdev_intern *xi;
+	int dropped, i, n;
+	uint8_t byte;
+
+	if (__predict_false(xm == NULL || xe == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xe->magic != XDEV_ENUMERATE_MAGIC ||
+	    xe->xdev != xm->xdev)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->tracking)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	xi = &xm->xdev->intern;
+	xm->attach = xdev_intern_string(xi, "device-attach");
+	xm->detach = xdev_intern_string(xi, "device-detach");
+	if (__predict_false(xm->attach == NULL || xm->detach == NULL))
+		return -1;
+
+	if (xm->worker == NULL) {
+		if (__predict_false(xdev_monitor_enable_receiving(xm) == -1))
+			return -1;
+	}
+
+	n = xdev_enumerate_scan_devices(xe, root_devname, max_depth);
+	if (__predict_false(n == -1))
+		return -1;
+
+	if (__predict_false(xdev_hash_init(&xm->members, n) == -1))
+		return -1;
+
+	TAILQ_FOREACH(xle, &xe->devices, link) {
+		xd = xle->device;
+		if (__predict_false(
+		    xdev_monitor_add_member(xm, xd->devname) == -1)) {
+			xdev_monitor_free_members(xm);
+			return -1;
+		}
+	}
+
+	pthread_mutex_lock(&xm->mutex);
+
+	for (i = 0; i < xm->num_queues; i++) {
+		xq = &xm->queues[i];
+
+		dropped = 0;
+		for (xle = TAILQ_FIRST(&xq->devices); xle != NULL; xle = next) {
+			next = TAILQ_NEXT(xle, link);
+			if (xdev_monitor_track(xm, xle->device))
+				continue;
+			TAILQ_REMOVE(&xq->devices, xle, link);
+			xdev_device_unref(xle->device);
+			xdev_pool_put_entry(xm->pool, xle);
+			dropped++;
 		}
 
-		xle = xdev_list_entry_new(xd);
-		if (__predict_false(xle == NULL)) {
-			break;
+		/* Keep one byte per entry in the pipe. */
+		while (dropped-- > 0) {
+			if (xread(xq->pipe_fd[0], &byte, 1) != 1)
+				break;
 		}
-		pthread_mutex_lock(&xm->mutex);
-		TAILQ_INSERT_TAIL(&xm->devices, xle, link);
-		pthread_mutex_unlock(&xm->mutex);
+	}
+
+	xm->tracking = true;
+
+	pthread_mutex_unlock(&xm->mutex);
+
+	return n;
+}
+
+/*
+ * Get the number of events a monitor attached to xdevd(8) missed
+ * because the ring wrapped before they were read.  A consumer seeing
+ * it grow has to scan again.
+ */
+int
+xdev_monitor_get_lost(struct xdev_monitor *xm, uint64_t *lost)
+{
+
+	if (__predict_false(xm == NULL || lost == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->ring == NULL)) {
+		errno = ENOTSUP;
+		return -1;
+	}
 
-		if (__predict_false(xwrite(xm->pipe_fd[1], &one, 1) != 1)) {
-			pthread_mutex_lock(&xm->mutex);
-			TAILQ_REMOVE(&xm->devices, xle, link);
-			pthread_mutex_unlock(&xm->mutex);
-			xdev_device_unref(xd);
-			free(xle);
+	pthread_mutex_lock(&xm->mutex);
+	*lost = xm->lost;
+	pthread_mutex_unlock(&xm->mutex);
+
+	return 0;
+}
+
+/*
+ * Queue the journaled events following seq, the last one the consumer
+ * has seen, in sequence order ahead of any newer ones.  Events still
+ * waiting in a queue are not queued twice; events received since seq,
+ * such as those after an overflow gap, are.  Fails with ESTALE if some
+ * have already left the journal (see xdev_set_journal()), the consumer
+ * then has to scan again.  Returns the number of events queued.
+ */
+int
+xdev_monitor_replay(struct xdev_monitor *xm, uint64_t seq)
+{
+	struct xdev_journal_entry *entries;
+	const char *event, *device, *parent;
+	ssize_t i, n;
+	int queued, ret;
+
+	if (__predict_false(xm == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	n = xdev_journal_since(&xm->xdev->journal, seq, &entries);
+	if (__predict_false(n == -1))
+		return -1;
+
+	queued = 0;
+	for (i = 0; i < n; i++) {
+		if (__predict_false(!xdev_monitor_parse(entries[i].ev, &event,
+		    &device, &parent))) {
+			prop_object_release(entries[i].ev);
 			continue;
 		}
+
+		ret = xdev_monitor_dispatch(xm, entries[i].ev, event, device,
+			parent, entries[i].seq, NULL, true);
+		if (__predict_false(ret == -1)) {
+			while (++i < n)
+				prop_object_release(entries[i].ev);
+			free(entries);
+			return -1;
+		}
+		queued += ret;
 	}
 
-	return NULL;
+	free(entries);
+
+	return queued;
 }
 
+/*
+ * Add a queue with its own descriptor for the devices match() returns 0
+ * for, like a filter keeps them.  Each event goes to the first queue
+ * that matches, trying higher priorities first, or else to the default
+ * queue of xdev_monitor_get_fd().  Must be called before receiving is
+ * enabled.  Returns the queue number.
+ */
 int
-xdev_monitor_enable_receiving(struct xdev_monitor *xm)
+xdev_monitor_add_queue(struct xdev_monitor *xm, int priority,
+	xdev_filter_cb match, void *match_cookie)
 {
-	int rv;
+	struct xdev_monitor_queue *xq;
+	int i, q;
 
-	if (__predict_false(xm == NULL)) {
+	if (__predict_false(xm == NULL || match == NULL)) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -349,16 +1085,78 @@ xdev_monitor_enable_receiving(struct xdev_monitor *xm)
 		return -1;
 	}
 
-	rv = pthread_create(&xm->thread, NULL, xdev_monitor_thread, xm);
-	if (__predict_false(rv != 0)) {
+	if (__predict_false(xm->worker != NULL)) {
+		errno = EBUSY;
 		return -1;
 	}
 
-	return 0;
+	if (__predict_false(xm->num_queues == XDEV_MONITOR_MAX_QUEUES)) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	q = xm->num_queues;
+	xq = &xm->queues[q];
+
+	if (__predict_false(xdev_workers_get_pipe(&xm->xdev->workers,
+	    xq->pipe_fd) == -1))
+		return -1;
+
+	TAILQ_INIT(&xq->devices);
+	xq->priority = priority;
+	xq->match = match;
+	xq->match_cookie = match_cookie;
+
+	/* Equal priorities keep the order they were added in. */
+	for (i = q - 1; i > 0; i--) {
+		if (xm->queues[xm->order[i - 1]].priority >= priority)
+			break;
+		xm->order[i] = xm->order[i - 1];
+	}
+	xm->order[i] = q;
+	xm->num_queues++;
+
+	return q;
+}
+
+static int
+xdev_monitor_match_subtree(struct xdev_device *xd, void *cookie)
+{
+
+	return xdev_ancestry_is_below(&xd->xdev->ancestry, xd->devname,
+		xd->parent, (const char *)cookie) == 1 ? 0 : 1;
 }
 
+/*
+ * Add a queue for the events of root and the devices below it, all of
+ * them for "".
+ */
 int
-xdev_monitor_get_fd(struct xdev_monitor *xm)
+xdev_monitor_add_subtree_queue(struct xdev_monitor *xm, int priority,
+	const char *root)
+{
+	const char *r;
+
+	if (__predict_false(xm == NULL || root == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(xm->magic != XDEV_MONITOR_MAGIC)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	r = xdev_intern_string(&xm->xdev->intern, root);
+	if (__predict_false(r == NULL))
+		return -1;
+
+	return xdev_monitor_add_queue(xm, priority, xdev_monitor_match_subtree,
+		__UNCONST(r));
+}
+
+int
+xdev_monitor_get_queue_fd(struct xdev_monitor *xm, int q)
 {
 
 	if (__predict_false(xm == NULL)) {
@@ -371,12 +1169,25 @@ xdev_monitor_get_fd(struct xdev_monitor *xm)
 		return -1;
 	}
 
-	return xm->pipe_fd[0];
+	if (__predict_false(q < 0 || q >= xm->num_queues)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return xm->queues[q].pipe_fd[0];
+}
+
+int
+xdev_monitor_get_fd(struct xdev_monitor *xm)
+{
+
+	return xdev_monitor_get_queue_fd(xm, 0);
 }
 
 struct xdev_device *
-xdev_monitor_receive_device(struct xdev_monitor *xm)
+xdev_monitor_receive_queue(struct xdev_monitor *xm, int q)
 {
+	struct xdev_monitor_queue *xq;
 	struct xdev_list_entry *xle;
 	struct xdev_device *xd;
 	uint8_t byte;
@@ -391,17 +1202,32 @@ xdev_monitor_receive_device(struct xdev_monitor *xm)
 		return NULL;
 	}
 
-	if (__predict_false(xread(xm->pipe_fd[0], &byte, 1) < 0))
+	if (__predict_false(q < 0 || q >= xm->num_queues)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	xq = &xm->queues[q];
+
+	if (__predict_false(xread(xq->pipe_fd[0], &byte, 1) < 0))
 		return NULL;
 
 	pthread_mutex_lock(&xm->mutex);
-	if (TAILQ_EMPTY(&xm->devices))
+	if (TAILQ_EMPTY(&xq->devices))
 		goto fail;
-	xle = TAILQ_FIRST(&xm->devices);
-	TAILQ_REMOVE(&xm->devices, xle, link);
+	xle = TAILQ_FIRST(&xq->devices);
+	TAILQ_REMOVE(&xq->devices, xle, link);
 	pthread_mutex_unlock(&xm->mutex);
-	xd = xdev_list_entry_get_device(xle);
-	free(xle);
+
+	/* The reference held by the queue passes to the caller. */
+	assert(xle->magic == XDEV_LIST_ENTRY_MAGIC);
+	xd = xle->device;
+	xdev_pool_put_entry(xm->pool, xle);
+
+	if (xm->timestamps)
+		clock_gettime(CLOCK_MONOTONIC, &xd->stamps[XDEV_STAMP_RECEIVE]);
+
+	XDEV_TRACEPOINT(xm->xdev, XDEV_TRACE_RECEIVE, xd->devname, xd->seq);
 
 	return xd;
 
@@ -410,3 +1236,10 @@ fail:
 	errno = ENOBUFS;
 	return NULL;
 }
+
+struct xdev_device *
+xdev_monitor_receive_device(struct xdev_monitor *xm)
+{
+
+	return xdev_monitor_receive_queue(xm, 0);
+}
@@ -32,23 +32,60 @@
 #define _XDEV_MONITOR_H_
 
 #include <pthread.h>
+#include <stdbool.h>
 
 #include "xdev.h"
+#include "xdev_hash.h"
 #include "xdev_list.h"
+#include "xdev_watch.h"
 
 #define XDEV_MONITOR_MAGIC 0x024385aa
 
+/* Free devices and queue entries kept around for reuse. */
+#define XDEV_MONITOR_POOL_SIZE 64
+
+/* Queues per monitor, the default one included. */
+#define XDEV_MONITOR_MAX_QUEUES 8
+
+/* How often to look for new events in an xdevd(8) ring, in ms. */
+#define XDEV_MONITOR_RING_INTERVAL 50
+
+struct xdev_pool;
+struct xdev_ring;
+struct xdev_worker;
+
+struct xdev_monitor_queue {
+	struct xdev_list devices;
+	int pipe_fd[2];		/* one byte per queued device */
+	int priority;
+	xdev_filter_cb match;	/* NULL for the default queue */
+	void *match_cookie;
+};
+
 struct xdev_monitor {
 	int refcnt;
 	int magic;
 	struct xdev *xdev;
 	xdev_filter_cb xfcb;
 	void *xfcb_cookie;
-	struct xdev_list devices;
-	int shutdown_fd[2]; /* self-pipe to stop the polling thread */
-	int pipe_fd[2];
-	pthread_t thread;
+	const char *subtree;		/* interned root, if scoped */
+	struct xdev_monitor_queue queues[XDEV_MONITOR_MAX_QUEUES];
+	int num_queues;
+	int order[XDEV_MONITOR_MAX_QUEUES - 1];	/* by priority, highest first */
+	struct xdev_worker *worker;	/* while receiving */
 	pthread_mutex_t mutex;
+	bool nocopy;
+	bool timestamps;
+	struct xdev_source source;
+	struct xdev_ring *ring;		/* source, if attached to xdevd(8) */
+	uint64_t lost;			/* by the ring, under mutex */
+	struct xdev_pool *pool;
+	bool tracking;			/* members is valid */
+	struct xdev_hash members;	/* devnames the consumer has seen */
+	const char *attach;		/* interned event names */
+	const char *detach;
+	uint64_t last_seq;		/* highest queued so far */
+	struct xdev_watches watches;
 };
 
 #endif /* !_XDEV_MONITOR_H_ */
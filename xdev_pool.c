@@ -0,0 +1,194 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/atomic.h>
+#include <sys/queue.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev.h"
+#include "xdev_device.h"
+#include "xdev_list.h"
+#include "xdev_pool.h"
+
+struct xdev_pool *
+xdev_pool_new(size_t max_free)
+{
+	struct xdev_pool *xp;
+
+	xp = (struct xdev_pool *)calloc(sizeof(*xp), 1);
+	if (__predict_false(xp == NULL))
+		return NULL;
+
+	if (__predict_false(pthread_mutex_init(&xp->mutex, NULL) != 0)) {
+		free(xp);
+		return NULL;
+	}
+
+	xp->refcnt = 1;
+	xp->max_free = max_free;
+	SLIST_INIT(&xp->devices);
+	TAILQ_INIT(&xp->entries);
+
+	return xp;
+}
+
+void
+xdev_pool_release(struct xdev_pool *xp)
+{
+	struct xdev_device *xd;
+	struct xdev_list_entry *e;
+
+	assert(xp != NULL);
+
+	membar_exit();
+	if (atomic_dec_uint_nv(&xp->refcnt) > 0)
+		return;
+	membar_enter();
+
+	while ((xd = SLIST_FIRST(&xp->devices)) != NULL) {
+		SLIST_REMOVE_HEAD(&xp->devices, free_link);
+		free(xd);
+	}
+
+	while ((e = TAILQ_FIRST(&xp->entries)) != NULL) {
+		TAILQ_REMOVE(&xp->entries, e, link);
+		free(e);
+	}
+
+	pthread_mutex_destroy(&xp->mutex);
+	free(xp);
+}
+
+/*
+ * Returns a zeroed device that goes back to the pool when its last
+ * reference is dropped.
+ */
+struct xdev_device *
+xdev_pool_get_device(struct xdev_pool *xp)
+{
+	struct xdev_device *xd;
+
+	assert(xp != NULL);
+
+	pthread_mutex_lock(&xp->mutex);
+	if ((xd = SLIST_FIRST(&xp->devices)) != NULL) {
+		SLIST_REMOVE_HEAD(&xp->devices, free_link);
+		xp->num_devices--;
+	}
+	pthread_mutex_unlock(&xp->mutex);
+
+	if (xd != NULL)
+		memset(xd, 0, sizeof(*xd));
+	else if ((xd = calloc(sizeof(*xd), 1)) == NULL)
+		return NULL;
+
+	atomic_inc_uint(&xp->refcnt);
+	xd->pool = xp;
+
+	return xd;
+}
+
+void
+xdev_pool_put_device(struct xdev_pool *xp, struct xdev_device *xd)
+{
+
+	assert(xp != NULL);
+	assert(xd != NULL);
+	assert(xd->pool == xp);
+	assert(xd->refcnt == 0);
+
+	xd->magic = 0xdeadbeef;
+
+	pthread_mutex_lock(&xp->mutex);
+	if (xp->num_devices < xp->max_free) {
+		SLIST_INSERT_HEAD(&xp->devices, xd, free_link);
+		xp->num_devices++;
+		xd = NULL;
+	}
+	pthread_mutex_unlock(&xp->mutex);
+
+	free(xd);
+	xdev_pool_release(xp);
+}
+
+struct xdev_list_entry *
+xdev_pool_get_entry(struct xdev_pool *xp, struct xdev_device *xd)
+{
+	struct xdev_list_entry *e;
+
+	assert(xp != NULL);
+	assert(xd != NULL);
+	assert(xd->magic == XDEV_DEVICE_MAGIC);
+
+	pthread_mutex_lock(&xp->mutex);
+	if ((e = TAILQ_FIRST(&xp->entries)) != NULL) {
+		TAILQ_REMOVE(&xp->entries, e, link);
+		xp->num_entries--;
+	}
+	pthread_mutex_unlock(&xp->mutex);
+
+	if (e == NULL)
+		return xdev_list_entry_new(xd);
+
+	e->device = xd;
+	e->magic = XDEV_LIST_ENTRY_MAGIC;
+
+	return e;
+}
+
+void
+xdev_pool_put_entry(struct xdev_pool *xp, struct xdev_list_entry *e)
+{
+
+	assert(xp != NULL);
+	assert(e != NULL);
+
+	e->magic = 0xdeadbeef;
+	e->device = NULL;
+
+	pthread_mutex_lock(&xp->mutex);
+	if (xp->num_entries < xp->max_free) {
+		TAILQ_INSERT_HEAD(&xp->entries, e, link);
+		xp->num_entries++;
+		e = NULL;
+	}
+	pthread_mutex_unlock(&xp->mutex);
+
+	free(e);
+}
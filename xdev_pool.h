@@ -0,0 +1,68 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_POOL_H_
+#define _XDEV_POOL_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <pthread.h>
+
+#include "xdev_device.h"
+#include "xdev_list.h"
+
+/*
+ * Free lists of devices and list entries, so that a monitor reuses the
+ * same objects event after event.  Each pooled device holds a reference
+ * to its pool, which lets devices outlive the monitor that made them.
+ */
+struct xdev_pool {
+	volatile unsigned int refcnt;
+	pthread_mutex_t mutex;
+	SLIST_HEAD(, xdev_device) devices;
+	struct xdev_list entries;
+	size_t num_devices;
+	size_t num_entries;
+	size_t max_free;
+};
+
+__BEGIN_HIDDEN_DECLS
+struct xdev_pool *xdev_pool_new(size_t);
+void xdev_pool_release(struct xdev_pool *);
+struct xdev_device *xdev_pool_get_device(struct xdev_pool *);
+void xdev_pool_put_device(struct xdev_pool *, struct xdev_device *);
+struct xdev_list_entry *xdev_pool_get_entry(struct xdev_pool *,
+	struct xdev_device *);
+void xdev_pool_put_entry(struct xdev_pool *, struct xdev_list_entry *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_POOL_H_ */
@@ -31,6 +31,18 @@
 #ifndef _XDEV_PRIVATE_H_
 #define _XDEV_PRIVATE_H_
 
+#include <sys/cdefs.h>
+
+#include "xdev.h"
+#include "xdev_ancestry.h"
+#include "xdev_cache.h"
+#include "xdev_devnode.h"
+#include "xdev_handle.h"
+#include "xdev_intern.h"
+#include "xdev_journal.h"
+#include "xdev_major.h"
+#include "xdev_worker.h"
+
 #define XDEV_MAGIC 0x1245780a
 
 struct xdev {
@@ -38,6 +50,36 @@ struct xdev {
 	int magic;
 	void *user;
 	int drvctl_fd;
+	struct xdev_cache cache;
+	struct xdev_intern intern;
+	struct xdev_handle_table handles;
+	struct xdev_journal journal;
+	struct xdev_workers workers;
+	struct xdev_devnodes devnodes;
+	struct xdev_majors majors;
+	struct xdev_ancestry ancestry;
+	xdev_trace_cb trace;
+	void *trace_cookie;
 };
 
+__BEGIN_HIDDEN_DECLS
+uint64_t xdev_notify_event(struct xdev *, prop_dictionary_t, const char *,
+	const char *, const char *);
+void xdev_trace(struct xdev *, int, const char *, uint64_t);
+__END_HIDDEN_DECLS
+
+/*
+ * Tracepoints cost nothing unless the library is built with XDEV_TRACE
+ * (make XDEV_TRACE=yes), and a branch while no callback is set.
+ */
+#ifdef XDEV_TRACE
+#define XDEV_TRACEPOINT(x, stage, devname, seq)				\
+	do {								\
+		if (__predict_false((x)->trace != NULL))		\
+			xdev_trace((x), (stage), (devname), (seq));	\
+	} while (/*CONSTCOND*/ 0)
+#else
+#define XDEV_TRACEPOINT(x, stage, devname, seq) __nothing
+#endif
+
 #endif /* !_XDEV_PRIVATE_H_ */
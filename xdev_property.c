@@ -0,0 +1,206 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <prop/proplib.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdev_property.h"
+#include "xdev_utils.h"
+
+static bool
+xdev_property_is_scalar(prop_object_t o)
+{
+
+	switch (prop_object_type(o)) {
+	case PROP_TYPE_STRING:
+	case PROP_TYPE_NUMBER:
+	case PROP_TYPE_BOOL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static char *
+xdev_property_strcpy(char **pool, const char *s)
+{
+	char *p;
+	size_t len;
+
+	len = strlen(s) + 1;
+	p = *pool;
+	memcpy(p, s, len);
+	*pool += len;
+
+	return p;
+}
+
+static void
+xdev_property_table_insert(struct xdev_property_table *xpt, char **pool,
+	const char *key, prop_object_t o)
+{
+	struct xdev_property *xp;
+	uint32_t hash;
+	size_t i;
+
+	hash = xstrhash(key);
+	for (i = hash & xpt->mask; xpt->slots[i].key != NULL;
+	    i = (i + 1) & xpt->mask)
+		continue;
+
+	xp = &xpt->slots[i];
+	xp->key = xdev_property_strcpy(pool, key);
+	xp->hash = hash;
+
+	switch (prop_object_type(o)) {
+	case PROP_TYPE_STRING:
+		xp->type = XDEV_PROPERTY_STRING;
+		xp->value.s = xdev_property_strcpy(pool,
+			prop_string_cstring_nocopy(o));
+		break;
+	case PROP_TYPE_NUMBER:
+		xp->type = XDEV_PROPERTY_NUMBER;
+		if (prop_number_unsigned(o)) {
+			xp->value.u = prop_number_unsigned_integer_value(o);
+		} else {
+			xp->value.u = prop_number_integer_value(o);
+			xp->negative = prop_number_integer_value(o) < 0;
+		}
+		break;
+	case PROP_TYPE_BOOL:
+		xp->type = XDEV_PROPERTY_BOOL;
+		xp->value.b = prop_bool_true(o);
+		break;
+	default:
+		assert(0 && "not reached");
+	}
+
+	xpt->count++;
+}
+
+/*
+ * Flatten the scalar members (strings, numbers and booleans) of the
+ * dictionary.  Nested containers and data blobs are skipped, they stay
+ * reachable through the externalized XML.
+ */
+struct xdev_property_table *
+xdev_property_table_new(prop_dictionary_t dict)
+{
+	struct xdev_property_table *xpt;
+	prop_object_iterator_t it;
+	prop_dictionary_keysym_t k;
+	prop_object_t o;
+	size_t count, slots, strsize;
+	char *pool;
+
+	assert(dict != NULL);
+
+	it = prop_dictionary_iterator(dict);
+	if (__predict_false(it == NULL))
+		return NULL;
+
+	count = 0;
+	strsize = 0;
+	while ((k = prop_object_iterator_next(it)) != NULL) {
+		o = prop_dictionary_get_keysym(dict, k);
+		if (!xdev_property_is_scalar(o))
+			continue;
+		count++;
+		strsize += strlen(prop_dictionary_keysym_cstring_nocopy(k)) + 1;
+		if (prop_object_type(o) == PROP_TYPE_STRING)
+			strsize += strlen(prop_string_cstring_nocopy(o)) + 1;
+	}
+
+	/* Keep the load factor at or below 1/2. */
+	for (slots = 1; slots < count * 2; slots <<= 1)
+		continue;
+
+	xpt = (struct xdev_property_table *)calloc(1,
+		sizeof(*xpt) + slots * sizeof(xpt->slots[0]) + strsize);
+	if (__predict_false(xpt == NULL)) {
+		prop_object_iterator_release(it);
+		return NULL;
+	}
+
+	xpt->mask = slots - 1;
+	pool = (char *)&xpt->slots[slots];
+
+	prop_object_iterator_reset(it);
+	while ((k = prop_object_iterator_next(it)) != NULL) {
+		o = prop_dictionary_get_keysym(dict, k);
+		if (!xdev_property_is_scalar(o))
+			continue;
+		xdev_property_table_insert(xpt, &pool,
+			prop_dictionary_keysym_cstring_nocopy(k), o);
+	}
+	prop_object_iterator_release(it);
+
+	assert(xpt->count == count);
+
+	return xpt;
+}
+
+void
+xdev_property_table_free(struct xdev_property_table *xpt)
+{
+
+	free(xpt);
+}
+
+const struct xdev_property *
+xdev_property_table_lookup(const struct xdev_property_table *xpt,
+	const char *key)
+{
+	const struct xdev_property *xp;
+	uint32_t hash;
+	size_t i;
+
+	assert(xpt != NULL);
+	assert(key != NULL);
+
+	hash = xstrhash(key);
+	for (i = hash & xpt->mask; xpt->slots[i].key != NULL;
+	    i = (i + 1) & xpt->mask) {
+		xp = &xpt->slots[i];
+		if (xp->hash == hash && strcmp(xp->key, key) == 0)
+			return xp;
+	}
+
+	return NULL;
+}
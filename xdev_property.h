@@ -0,0 +1,74 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_PROPERTY_H_
+#define _XDEV_PROPERTY_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <prop/proplib.h>
+#include <stdbool.h>
+
+#define XDEV_PROPERTY_STRING	1
+#define XDEV_PROPERTY_NUMBER	2
+#define XDEV_PROPERTY_BOOL	3
+
+struct xdev_property {
+	const char *key;	/* NULL marks an empty slot */
+	uint32_t hash;
+	int type;
+	bool negative;		/* signed number below zero */
+	union {
+		const char *s;
+		uint64_t u;
+		bool b;
+	} value;
+};
+
+/*
+ * Open-addressing (linear probing) table of the scalar properties of
+ * a device.  The slots and all the strings they point to live in the
+ * same allocation as the table header.
+ */
+struct xdev_property_table {
+	size_t mask;
+	size_t count;
+	struct xdev_property slots[];
+};
+
+__BEGIN_HIDDEN_DECLS
+struct xdev_property_table *xdev_property_table_new(prop_dictionary_t);
+void xdev_property_table_free(struct xdev_property_table *);
+const struct xdev_property *
+xdev_property_table_lookup(const struct xdev_property_table *, const char *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_PROPERTY_H_ */
@@ -0,0 +1,370 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/atomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xdev_ring.h"
+#include "xdev_utils.h"
+
+static struct xdev_ring_slot *
+xdev_ring_slot(struct xdev_ring *r, uint64_t seq)
+{
+	struct xdev_ring_header *h;
+
+	h = r->header;
+
+	return (struct xdev_ring_slot *)((char *)(h + 1) +
+	    (size_t)(seq % h->num_slots) * h->slot_size);
+}
+
+/*
+ * Create the ring under a temporary name and move it into place, so
+ * readers never map a half initialized one.  Readers notice the new
+ * ring once they have drained the old one.
+ */
+int
+xdev_ring_create(struct xdev_ring *r, const char *path, uint32_t num_slots)
+{
+	struct xdev_ring_header *h;
+	char tmp[PATH_MAX];
+	size_t size;
+	void *p;
+	int fd;
+
+	assert(r != NULL);
+	assert(path != NULL);
+
+	if (__predict_false(num_slots == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (__predict_false(snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >=
+	    (int)sizeof(tmp))) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	size = sizeof(*h) + (size_t)num_slots * XDEV_RING_SLOT_SIZE;
+
+	fd = mkstemp(tmp);
+	if (__predict_false(fd == -1))
+		return -1;
+
+	if (__predict_false(fchmod(fd, 0644) == -1))
+		goto fail;
+
+	if (__predict_false(ftruncate(fd, (off_t)size) == -1))
+		goto fail;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FILE,
+		fd, 0);
+	if (__predict_false(p == MAP_FAILED))
+		goto fail;
+
+	xclose(fd);
+
+	h = (struct xdev_ring_header *)p;
+	h->magic = XDEV_RING_MAGIC;
+	h->version = XDEV_RING_VERSION;
+	h->num_slots = num_slots;
+	h->slot_size = XDEV_RING_SLOT_SIZE;
+	h->head = 0;
+
+	if (__predict_false(rename(tmp, path) == -1)) {
+		munmap(p, size);
+		unlink(tmp);
+		return -1;
+	}
+
+	r->header = h;
+	r->map_size = size;
+	r->path = NULL;
+	r->cursor = 0;
+	r->lost = 0;
+
+	return 0;
+
+fail:
+	xclose(fd);
+	unlink(tmp);
+
+	return -1;
+}
+
+static int
+xdev_ring_map(struct xdev_ring *r, const char *path)
+{
+	struct xdev_ring_header *h;
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = xopen(path, O_RDONLY | O_CLOEXEC);
+	if (__predict_false(fd == -1))
+		return -1;
+
+	if (__predict_false(fstat(fd, &st) == -1))
+		goto fail;
+
+	if (__predict_false(st.st_size < (off_t)sizeof(*h))) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED | MAP_FILE,
+		fd, 0);
+	if (__predict_false(p == MAP_FAILED))
+		goto fail;
+
+	xclose(fd);
+
+	h = (struct xdev_ring_header *)p;
+	if (__predict_false(h->magic != XDEV_RING_MAGIC ||
+	    h->version != XDEV_RING_VERSION ||
+	    h->num_slots == 0 ||
+	    h->slot_size < sizeof(struct xdev_ring_slot) + 2 ||
+	    h->slot_size % sizeof(uint64_t) != 0 ||
+	    (size_t)st.st_size <
+	    sizeof(*h) + (size_t)h->num_slots * h->slot_size)) {
+		munmap(p, (size_t)st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+
+	r->header = h;
+	r->map_size = (size_t)st.st_size;
+	r->dev = st.st_dev;
+	r->ino = st.st_ino;
+
+	return 0;
+
+fail:
+	xclose(fd);
+
+	return -1;
+}
+
+/*
+ * Map the ring at path for reading.  Reading starts with the events
+ * published after it was opened.
+ */
+int
+xdev_ring_open(struct xdev_ring *r, const char *path)
+{
+
+	assert(r != NULL);
+	assert(path != NULL);
+
+	r->path = strdup(path);
+	if (__predict_false(r->path == NULL))
+		return -1;
+
+	if (__predict_false(xdev_ring_map(r, path) == -1)) {
+		free(r->path);
+		r->path = NULL;
+		return -1;
+	}
+
+	r->cursor = r->header->head;
+	r->lost = 0;
+
+	return 0;
+}
+
+/*
+ * A restarted broker renames a new ring over the path; read that one
+ * from its first event.  Events left in the old ring are read before
+ * this is tried, and a path that is gone means the broker is not back
+ * yet.
+ */
+static int
+xdev_ring_reopen(struct xdev_ring *r)
+{
+	struct xdev_ring_header *h;
+	struct stat st;
+	size_t size;
+
+	if (stat(r->path, &st) == -1 ||
+	    (st.st_dev == r->dev && st.st_ino == r->ino)) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	h = r->header;
+	size = r->map_size;
+
+	if (__predict_false(xdev_ring_map(r, r->path) == -1)) {
+		if (errno == ENOENT)
+			errno = EAGAIN;
+		return -1;
+	}
+
+	munmap(h, size);
+	r->cursor = 0;
+
+	return 0;
+}
+
+void
+xdev_ring_close(struct xdev_ring *r)
+{
+
+	assert(r != NULL);
+
+	if (r->header != NULL)
+		munmap(r->header, r->map_size);
+	free(r->path);
+
+	r->header = NULL;
+	r->path = NULL;
+}
+
+/*
+ * Publish len bytes of externalized event.  Only the broker writes.
+ */
+int
+xdev_ring_put(struct xdev_ring *r, const char *xml, size_t len)
+{
+	struct xdev_ring_slot *s;
+	uint64_t seq;
+
+	assert(r != NULL);
+	assert(r->header != NULL);
+	assert(xml != NULL);
+
+	/* Leave room for the NUL and the byte never written. */
+	if (__predict_false(len + 2 >
+	    r->header->slot_size - sizeof(struct xdev_ring_slot))) {
+		errno = E2BIG;
+		return -1;
+	}
+
+	seq = r->cursor + 1;
+	s = xdev_ring_slot(r, seq);
+
+	s->seq = 0;
+	membar_producer();
+	memcpy(s->data, xml, len);
+	s->data[len] = '\0';
+	s->len = (uint32_t)len;
+	membar_producer();
+	s->seq = seq;
+	membar_producer();
+	r->header->head = seq;
+
+	r->cursor = seq;
+
+	return 0;
+}
+
+/*
+ * Read the next event.  The dictionary is internalized straight from
+ * the mapping and thrown away if the broker overwrote the slot in the
+ * meantime; events overwritten before they could be read are counted
+ * in lost and skipped.  Returns -1 and EAGAIN if there is nothing new,
+ * or another errno if the ring that replaced ours cannot be mapped.
+ */
+int
+xdev_ring_get(struct xdev_ring *r, prop_dictionary_t *evp)
+{
+	struct xdev_ring_header *h;
+	struct xdev_ring_slot *s;
+	prop_dictionary_t ev;
+	uint64_t head, want;
+
+	assert(r != NULL);
+	assert(r->header != NULL);
+	assert(r->path != NULL);
+	assert(evp != NULL);
+
+	h = r->header;
+
+	for (;;) {
+		head = h->head;
+		membar_consumer();
+
+		if (head <= r->cursor) {
+			if (__predict_false(xdev_ring_reopen(r) == -1))
+				return -1;
+			h = r->header;
+			continue;
+		}
+
+		if (head - r->cursor > h->num_slots) {
+			r->lost += head - h->num_slots - r->cursor;
+			r->cursor = head - h->num_slots;
+		}
+
+		want = r->cursor + 1;
+		s = xdev_ring_slot(r, want);
+
+		if (s->seq != want) {
+			r->lost++;
+			r->cursor = want;
+			continue;
+		}
+		membar_consumer();
+
+		ev = prop_dictionary_internalize(s->data);
+
+		membar_consumer();
+		if (__predict_false(s->seq != want)) {
+			if (ev != NULL)
+				prop_object_release(ev);
+			r->lost++;
+			r->cursor = want;
+			continue;
+		}
+
+		r->cursor = want;
+
+		if (__predict_true(ev != NULL)) {
+			*evp = ev;
+			return 0;
+		}
+	}
+}
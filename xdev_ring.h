@@ -0,0 +1,87 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_RING_H_
+#define _XDEV_RING_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include <prop/proplib.h>
+#include <stdint.h>
+
+#define XDEV_RING_MAGIC 0x78726e67
+#define XDEV_RING_VERSION 1
+
+#define XDEV_RING_PATH "/var/run/xdevd.ring"
+#define XDEV_RING_SLOTS 256
+#define XDEV_RING_SLOT_SIZE 4096
+
+/*
+ * Events published by xdevd(8) to any number of readers, as a file
+ * mapped by all of them.  The broker is the only writer; readers map
+ * the file read-only and each keeps its own cursor.  Slot i % num_slots
+ * holds event i, externalized, and is valid while its seq says so.
+ * The last byte of a slot is never written, so a torn slot is still
+ * NUL terminated.
+ */
+struct xdev_ring_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_slots;
+	uint32_t slot_size;
+	volatile uint64_t head;		/* last published seq */
+};
+
+struct xdev_ring_slot {
+	volatile uint64_t seq;		/* 0 while being written */
+	uint32_t len;
+	char data[];
+};
+
+struct xdev_ring {
+	struct xdev_ring_header *header;
+	size_t map_size;
+	char *path;			/* reopened if replaced, readers */
+	dev_t dev;			/* of the file mapped */
+	ino_t ino;
+	uint64_t cursor;		/* last seq read or written */
+	uint64_t lost;			/* overwritten before read */
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_ring_create(struct xdev_ring *, const char *, uint32_t);
+int xdev_ring_open(struct xdev_ring *, const char *);
+void xdev_ring_close(struct xdev_ring *);
+int xdev_ring_put(struct xdev_ring *, const char *, size_t);
+int xdev_ring_get(struct xdev_ring *, prop_dictionary_t *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_RING_H_ */
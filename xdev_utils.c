@@ -102,6 +102,33 @@ xpoll(struct pollfd *fds, nfds_t nfds, int timeout)
 	return ret;
 }
 
+/* 32-bit FNV-1a */
+uint32_t
+xstrhash(const char *s)
+{
+	uint32_t h;
+
+	for (h = 2166136261U; *s != '\0'; s++) {
+		h ^= (uint8_t)*s;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+uint64_t
+xstrhash64(const char *s)
+{
+	uint64_t h;
+
+	for (h = 14695981039346656037ULL; *s != '\0'; s++) {
+		h ^= (uint8_t)*s;
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
 struct kinfo_drivers *
 kinfo_getdrivers(size_t *cntp)
 {
@@ -43,6 +43,8 @@ int xclose(int);
 ssize_t xwrite(int, const void *, size_t);
 ssize_t xread(int, void *, size_t);
 int xpoll(struct pollfd *, nfds_t, int);
+uint32_t xstrhash(const char *);
+uint64_t xstrhash64(const char *);
 
 struct kinfo_drivers *kinfo_getdrivers(size_t *);
 __END_HIDDEN_DECLS
@@ -0,0 +1,410 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/time.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xdev_device.h"
+#include "xdev_private.h"
+#include "xdev_utils.h"
+#include "xdev_watch.h"
+
+int
+xdev_watches_init(struct xdev_watches *ws)
+{
+	int error;
+
+	assert(ws != NULL);
+
+	ws->interval = 0;
+	ws->batch = 0;
+	TAILQ_INIT(&ws->due);
+
+	error = pthread_mutex_init(&ws->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	if (__predict_false(xdev_hash_init(&ws->bydevname, 0) == -1)) {
+		pthread_mutex_destroy(&ws->mutex);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+xdev_watches_fini(struct xdev_watches *ws)
+{
+	struct xdev_watch *w;
+
+	assert(ws != NULL);
+
+	while ((w = TAILQ_FIRST(&ws->due)) != NULL) {
+		TAILQ_REMOVE(&ws->due, w, link);
+		free(w);
+	}
+	xdev_hash_fini(&ws->bydevname);
+	pthread_mutex_destroy(&ws->mutex);
+}
+
+/*
+ * Only while the monitor is not receiving: the monitor thread reads
+ * interval and batch without the lock.
+ */
+int
+xdev_watches_setup(struct xdev_watches *ws, unsigned int interval,
+	unsigned int batch)
+{
+
+	assert(ws != NULL);
+
+	if (__predict_false(interval > 0 && batch == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ws->interval = interval;
+	ws->batch = batch;
+
+	return 0;
+}
+
+static void
+xdev_watches_add_ms(struct timespec *ts, unsigned int ms)
+{
+	struct timespec d;
+
+	d.tv_sec = ms / 1000;
+	d.tv_nsec = (ms % 1000) * 1000000L;
+	timespecadd(ts, &d, ts);
+}
+
+static void
+xdev_watches_insert(struct xdev_watches *ws, struct xdev_watch *w)
+{
+	struct xdev_watch *p;
+
+	/* Rescheduled devices are due last, start looking there. */
+	TAILQ_FOREACH_REVERSE(p, &ws->due, xdev_watch_list, link) {
+		if (timespeccmp(&p->due, &w->due, <=))
+			break;
+	}
+	if (p == NULL)
+		TAILQ_INSERT_HEAD(&ws->due, w, link);
+	else
+		TAILQ_INSERT_AFTER(&ws->due, p, w, link);
+}
+
+static int
+xdev_watches_fetch(struct xdev *x, prop_dictionary_t c, const char *devname,
+	uint64_t *fingerprint)
+{
+	struct xdev_device *xd;
+	int ret;
+
+	xd = xdev_device_fetch(x, c, devname);
+	if (xd == NULL)
+		return -1;
+
+	ret = xdev_device_get_fingerprint(xd, fingerprint);
+	xdev_device_unref(xd);
+
+	return ret;
+}
+
+/*
+ * Start watching devname, taking its current properties as the ones
+ * later polls compare against.  Fails with ENODEV if there is no such
+ * device.
+ */
+int
+xdev_watches_add(struct xdev_watches *ws, struct xdev *x, const char *devname)
+{
+	struct xdev_watch *w;
+	prop_dictionary_t c;
+	size_t len;
+	int error;
+
+	assert(ws != NULL);
+	assert(x != NULL);
+	assert(devname != NULL);
+
+	if (__predict_false(ws->interval == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&ws->mutex);
+	w = (struct xdev_watch *)xdev_hash_get(&ws->bydevname, devname);
+	pthread_mutex_unlock(&ws->mutex);
+	if (w != NULL)
+		return 0;
+
+	len = strlen(devname) + 1;
+	w = (struct xdev_watch *)calloc(sizeof(*w) + len, 1);
+	if (__predict_false(w == NULL))
+		return -1;
+	memcpy(w->devname, devname, len);
+
+	c = xdev_device_command_new();
+	if (__predict_false(c == NULL))
+		goto fail;
+	error = xdev_watches_fetch(x, c, w->devname, &w->fingerprint);
+	prop_object_release(c);
+	if (__predict_false(error == -1))
+		goto fail;
+	w->known = true;
+
+	clock_gettime(CLOCK_MONOTONIC, &w->due);
+	xdev_watches_add_ms(&w->due,
+		ws->interval + xstrhash(w->devname) % ws->interval);
+
+	pthread_mutex_lock(&ws->mutex);
+	/* Added meanwhile by another thread. */
+	if (xdev_hash_get(&ws->bydevname, w->devname) != NULL) {
+		pthread_mutex_unlock(&ws->mutex);
+		free(w);
+		return 0;
+	}
+	if (__predict_false(xdev_hash_put(&ws->bydevname, w->devname,
+	    w) == -1)) {
+		pthread_mutex_unlock(&ws->mutex);
+		goto fail;
+	}
+	xdev_watches_insert(ws, w);
+	pthread_mutex_unlock(&ws->mutex);
+
+	return 0;
+
+fail:
+	error = errno;
+	free(w);
+	errno = error;
+
+	return -1;
+}
+
+int
+xdev_watches_remove(struct xdev_watches *ws, const char *devname)
+{
+	struct xdev_watch *w;
+
+	assert(ws != NULL);
+	assert(devname != NULL);
+
+	pthread_mutex_lock(&ws->mutex);
+	w = (struct xdev_watch *)xdev_hash_remove(&ws->bydevname, devname);
+	if (__predict_false(w == NULL)) {
+		pthread_mutex_unlock(&ws->mutex);
+		errno = ENOENT;
+		return -1;
+	}
+	if (w->polling) {
+		w->removed = true;
+	} else {
+		TAILQ_REMOVE(&ws->due, w, link);
+		free(w);
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	return 0;
+}
+
+/*
+ * Shorten a poll(2) timeout in ms to when the next device is due.
+ * Without devices it is still capped at one interval, as a device may
+ * be added meanwhile.
+ */
+int
+xdev_watches_timeout(struct xdev_watches *ws, int timeout)
+{
+	struct timespec now, d;
+	struct xdev_watch *w;
+	long long ms;
+
+	assert(ws != NULL);
+
+	if (ws->interval == 0)
+		return timeout;
+
+	ms = ws->interval;
+
+	pthread_mutex_lock(&ws->mutex);
+	w = TAILQ_FIRST(&ws->due);
+	if (w != NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespeccmp(&w->due, &now, <=)) {
+			ms = 0;
+		} else {
+			timespecsub(&w->due, &now, &d);
+			ms = (long long)d.tv_sec * 1000 +
+			    (d.tv_nsec + 999999) / 1000000;
+		}
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	if (timeout == INFTIM || ms < timeout)
+		return ms > INT_MAX ? INT_MAX : (int)ms;
+	return timeout;
+}
+
+/*
+ * Poll up to one batch of the devices that are due and call cb with
+ * the new properties of those that changed.  Each device costs one
+ * get-properties request; the batch ends early once it has taken
+ * XDEV_WATCH_BUDGET, and the devices left stay due for the next call.
+ * Devices that cannot be read, detached ones, are polled on and
+ * compare against their next properties read.  Returns the number of
+ * changed devices.
+ */
+int
+xdev_watches_poll(struct xdev_watches *ws, struct xdev *x, xdev_watches_cb cb,
+	void *cookie)
+{
+	struct xdev_watch_list batch;
+	struct xdev_watch *w, *stop;
+	struct xdev_device *xd;
+	struct timespec now, end;
+	prop_dictionary_t c;
+	uint64_t fingerprint;
+	unsigned int n;
+	int changed;
+	bool polled, removed;
+
+	assert(ws != NULL);
+	assert(x != NULL);
+	assert(cb != NULL);
+
+	if (ws->interval == 0)
+		return 0;
+
+	TAILQ_INIT(&batch);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&ws->mutex);
+	for (n = 0; n < ws->batch; n++) {
+		w = TAILQ_FIRST(&ws->due);
+		if (w == NULL || timespeccmp(&w->due, &now, >))
+			break;
+		TAILQ_REMOVE(&ws->due, w, link);
+		TAILQ_INSERT_TAIL(&batch, w, link);
+		w->polling = true;
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	if (n == 0)
+		return 0;
+
+	end = now;
+	xdev_watches_add_ms(&end, XDEV_WATCH_BUDGET);
+
+	/* The command is reused, the requests are one per device. */
+	c = xdev_device_command_new();
+
+	changed = 0;
+	for (w = TAILQ_FIRST(&batch); w != NULL; w = TAILQ_NEXT(w, link)) {
+		/* Always get one done, so the batch moves on. */
+		if (w != TAILQ_FIRST(&batch)) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (timespeccmp(&now, &end, >=))
+				break;
+		}
+
+		xd = c != NULL ? xdev_device_fetch(x, c, w->devname) : NULL;
+		if (xd == NULL ||
+		    xdev_device_get_fingerprint(xd, &fingerprint) == -1) {
+			if (xd != NULL)
+				xdev_device_unref(xd);
+			w->known = false;
+			continue;
+		}
+
+		if (w->known && w->fingerprint != fingerprint) {
+			pthread_mutex_lock(&ws->mutex);
+			removed = w->removed;
+			pthread_mutex_unlock(&ws->mutex);
+			if (!removed) {
+				(*cb)(xd, cookie);
+				changed++;
+			}
+		}
+		w->fingerprint = fingerprint;
+		w->known = true;
+		xdev_device_unref(xd);
+	}
+	stop = w;
+
+	if (c != NULL)
+		prop_object_release(c);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	polled = true;
+
+	pthread_mutex_lock(&ws->mutex);
+	while ((w = TAILQ_FIRST(&batch)) != NULL) {
+		TAILQ_REMOVE(&batch, w, link);
+		/* The rest of the batch is still due. */
+		if (w == stop)
+			polled = false;
+		if (w->removed) {
+			free(w);
+			continue;
+		}
+		w->polling = false;
+		if (polled) {
+			xdev_watches_add_ms(&w->due, ws->interval);
+			/* Fallen behind: skip the missed polls. */
+			if (timespeccmp(&w->due, &now, <=)) {
+				w->due = now;
+				xdev_watches_add_ms(&w->due, ws->interval);
+			}
+		}
+		xdev_watches_insert(ws, w);
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	return changed;
+}
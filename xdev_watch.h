@@ -0,0 +1,90 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_WATCH_H_
+#define _XDEV_WATCH_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "xdev.h"
+#include "xdev_hash.h"
+
+/* How long one wakeup may spend polling a batch, in ms. */
+#define XDEV_WATCH_BUDGET 10
+
+/* Watches come and go with hotplug: each owns its devname. */
+struct xdev_watch {
+	uint64_t fingerprint;		/* of the last poll, if known */
+	bool known;			/* false while the device is gone */
+	bool polling;			/* off the due list */
+	bool removed;			/* while polling, free it after */
+	struct timespec due;
+	TAILQ_ENTRY(xdev_watch) link;
+	char devname[];
+};
+
+TAILQ_HEAD(xdev_watch_list, xdev_watch);
+
+/*
+ * Devices whose properties a monitor re-reads every interval ms, to
+ * report the ones that changed.  Each device gets a fixed offset in
+ * the interval, derived from its name, so that polls spread out rather
+ * than coming all at once; at most batch devices are polled in a row,
+ * and fewer if that takes longer than XDEV_WATCH_BUDGET.
+ */
+struct xdev_watches {
+	pthread_mutex_t mutex;
+	unsigned int interval;		/* 0 when not watching */
+	unsigned int batch;
+	struct xdev_hash bydevname;
+	struct xdev_watch_list due;	/* soonest first */
+};
+
+typedef void (*xdev_watches_cb)(struct xdev_device *, void *);
+
+__BEGIN_HIDDEN_DECLS
+int xdev_watches_init(struct xdev_watches *);
+void xdev_watches_fini(struct xdev_watches *);
+int xdev_watches_setup(struct xdev_watches *, unsigned int, unsigned int);
+int xdev_watches_add(struct xdev_watches *, struct xdev *, const char *);
+int xdev_watches_remove(struct xdev_watches *, const char *);
+int xdev_watches_timeout(struct xdev_watches *, int);
+int xdev_watches_poll(struct xdev_watches *, struct xdev *, xdev_watches_cb,
+	void *);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_WATCH_H_ */
@@ -0,0 +1,281 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xdev_utils.h"
+#include "xdev_worker.h"
+
+static void *
+xdev_worker_thread(void *arg)
+{
+	struct xdev_worker *w;
+	void (*run)(void *, int);
+
+	w = (struct xdev_worker *)arg;
+
+	pthread_mutex_lock(&w->mutex);
+	for (;;) {
+		while (w->run == NULL && !w->exit)
+			pthread_cond_wait(&w->cv, &w->mutex);
+		if (w->exit)
+			break;
+		run = w->run;
+		pthread_mutex_unlock(&w->mutex);
+
+		(*run)(w->arg, w->wake_fd[0]);
+
+		pthread_mutex_lock(&w->mutex);
+		w->run = NULL;
+		w->arg = NULL;
+		pthread_cond_broadcast(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	return NULL;
+}
+
+static struct xdev_worker *
+xdev_worker_new(void)
+{
+	struct xdev_worker *w;
+
+	w = (struct xdev_worker *)calloc(sizeof(*w), 1);
+	if (__predict_false(w == NULL))
+		return NULL;
+
+	if (__predict_false(pipe2(w->wake_fd, O_CLOEXEC | O_NONBLOCK) == -1))
+		goto fail;
+
+	if (__predict_false(pthread_mutex_init(&w->mutex, NULL) != 0))
+		goto fail2;
+
+	if (__predict_false(pthread_cond_init(&w->cv, NULL) != 0))
+		goto fail3;
+
+	if (__predict_false(pthread_create(&w->thread, NULL,
+	    xdev_worker_thread, w) != 0))
+		goto fail4;
+
+	return w;
+
+fail4:
+	pthread_cond_destroy(&w->cv);
+fail3:
+	pthread_mutex_destroy(&w->mutex);
+fail2:
+	xclose(w->wake_fd[0]);
+	xclose(w->wake_fd[1]);
+fail:
+	free(w);
+
+	return NULL;
+}
+
+static void
+xdev_worker_destroy(struct xdev_worker *w)
+{
+
+	pthread_mutex_lock(&w->mutex);
+	w->exit = true;
+	pthread_cond_broadcast(&w->cv);
+	pthread_mutex_unlock(&w->mutex);
+
+	pthread_join(w->thread, NULL);
+
+	pthread_cond_destroy(&w->cv);
+	pthread_mutex_destroy(&w->mutex);
+	xclose(w->wake_fd[0]);
+	xclose(w->wake_fd[1]);
+	free(w);
+}
+
+int
+xdev_workers_init(struct xdev_workers *ws)
+{
+	int error;
+
+	assert(ws != NULL);
+
+	memset(ws, 0, sizeof(*ws));
+
+	error = pthread_mutex_init(&ws->mutex, NULL);
+	if (__predict_false(error != 0)) {
+		errno = error;
+		return -1;
+	}
+
+	SLIST_INIT(&ws->free);
+
+	return 0;
+}
+
+void
+xdev_workers_fini(struct xdev_workers *ws)
+{
+	struct xdev_worker *w;
+	size_t i;
+
+	assert(ws != NULL);
+
+	while ((w = SLIST_FIRST(&ws->free)) != NULL) {
+		SLIST_REMOVE_HEAD(&ws->free, link);
+		xdev_worker_destroy(w);
+	}
+
+	for (i = 0; i < ws->num_pipes; i++) {
+		xclose(ws->pipes[i][0]);
+		xclose(ws->pipes[i][1]);
+	}
+
+	pthread_mutex_destroy(&ws->mutex);
+}
+
+/*
+ * Have an idle worker, or a new one, call run(arg, wake_fd).
+ */
+struct xdev_worker *
+xdev_workers_start(struct xdev_workers *ws, void (*run)(void *, int),
+	void *arg)
+{
+	struct xdev_worker *w;
+
+	assert(ws != NULL);
+	assert(run != NULL);
+
+	pthread_mutex_lock(&ws->mutex);
+	if ((w = SLIST_FIRST(&ws->free)) != NULL) {
+		SLIST_REMOVE_HEAD(&ws->free, link);
+		ws->num_free--;
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	if (w == NULL && (w = xdev_worker_new()) == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&w->mutex);
+	w->run = run;
+	w->arg = arg;
+	pthread_cond_broadcast(&w->cv);
+	pthread_mutex_unlock(&w->mutex);
+
+	return w;
+}
+
+/*
+ * Make run() return, unless it already has, and park the worker.
+ */
+void
+xdev_workers_stop(struct xdev_workers *ws, struct xdev_worker *w)
+{
+	uint8_t byte;
+
+	assert(ws != NULL);
+	assert(w != NULL);
+
+	byte = '1';
+	xwrite(w->wake_fd[1], &byte, 1);
+
+	pthread_mutex_lock(&w->mutex);
+	while (w->run != NULL)
+		pthread_cond_wait(&w->cv, &w->mutex);
+	pthread_mutex_unlock(&w->mutex);
+
+	while (xread(w->wake_fd[0], &byte, 1) == 1)
+		continue;
+
+	pthread_mutex_lock(&ws->mutex);
+	if (ws->num_free < XDEV_WORKERS_MAX_FREE) {
+		SLIST_INSERT_HEAD(&ws->free, w, link);
+		ws->num_free++;
+		w = NULL;
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	if (w != NULL)
+		xdev_worker_destroy(w);
+}
+
+/*
+ * A non-blocking, close-on-exec pipe, empty.
+ */
+int
+xdev_workers_get_pipe(struct xdev_workers *ws, int fd[2])
+{
+
+	assert(ws != NULL);
+
+	pthread_mutex_lock(&ws->mutex);
+	if (ws->num_pipes > 0) {
+		ws->num_pipes--;
+		fd[0] = ws->pipes[ws->num_pipes][0];
+		fd[1] = ws->pipes[ws->num_pipes][1];
+		pthread_mutex_unlock(&ws->mutex);
+		return 0;
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	return pipe2(fd, O_CLOEXEC | O_NONBLOCK);
+}
+
+void
+xdev_workers_put_pipe(struct xdev_workers *ws, int fd[2])
+{
+	char buf[64];
+
+	assert(ws != NULL);
+
+	while (xread(fd[0], buf, sizeof(buf)) > 0)
+		continue;
+
+	pthread_mutex_lock(&ws->mutex);
+	if (ws->num_pipes < XDEV_WORKERS_MAX_PIPES) {
+		ws->pipes[ws->num_pipes][0] = fd[0];
+		ws->pipes[ws->num_pipes][1] = fd[1];
+		ws->num_pipes++;
+		pthread_mutex_unlock(&ws->mutex);
+		return;
+	}
+	pthread_mutex_unlock(&ws->mutex);
+
+	xclose(fd[0]);
+	xclose(fd[1]);
+}
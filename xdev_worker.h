@@ -0,0 +1,83 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _XDEV_WORKER_H_
+#define _XDEV_WORKER_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/* Idle threads and spare pipes kept per xdev. */
+#define XDEV_WORKERS_MAX_FREE 4
+#define XDEV_WORKERS_MAX_PIPES 16
+
+/*
+ * A thread running one function at a time, parked on cv in between.
+ * run() polls wake_fd[0] and returns once it is readable.
+ */
+struct xdev_worker {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cv;
+	int wake_fd[2];
+	void (*run)(void *, int);	/* NULL while parked */
+	void *arg;
+	bool exit;
+	SLIST_ENTRY(xdev_worker) link;
+};
+
+/*
+ * Monitor threads and pipes outlive their monitors here, so that a
+ * monitor can be started and stopped without creating and joining a
+ * thread or opening and closing descriptors.
+ */
+struct xdev_workers {
+	pthread_mutex_t mutex;
+	SLIST_HEAD(, xdev_worker) free;
+	size_t num_free;
+	int pipes[XDEV_WORKERS_MAX_PIPES][2];
+	size_t num_pipes;
+};
+
+__BEGIN_HIDDEN_DECLS
+int xdev_workers_init(struct xdev_workers *);
+void xdev_workers_fini(struct xdev_workers *);
+struct xdev_worker *xdev_workers_start(struct xdev_workers *,
+	void (*)(void *, int), void *);
+void xdev_workers_stop(struct xdev_workers *, struct xdev_worker *);
+int xdev_workers_get_pipe(struct xdev_workers *, int [2]);
+void xdev_workers_put_pipe(struct xdev_workers *, int [2]);
+__END_HIDDEN_DECLS
+
+#endif /* !_XDEV_WORKER_H_ */
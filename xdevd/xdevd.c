@@ -0,0 +1,235 @@
+/*	$NetBSD$	*/
+/*-
+ * Copyright (c) 2021 The NetBSD Foundation, Inc.
+ * All rights reserved.
+ *
+ * This code is derived from software contributed to The NetBSD Foundation
+ * by Kamil Rytarowski.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * xdevd - publish drvctl(4) events to any number of libxdev monitors
+ *
+ * drvctl(4) hands each event to one reader only and wants write access
+ * for it.  xdevd is that one reader and copies every event into a ring
+ * mapped read-only by the monitors, see xdev_monitor_attach_ring().
+ */
+
+#include <sys/cdefs.h>
+__RCSID("$NetBSD$");
+
+#include <sys/types.h>
+#include <sys/drvctlio.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <prop/proplib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <util.h>
+
+#include "xdev_ring.h"
+
+static void __dead
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s [-ds] [-n slots] [-r ring]\n",
+	    getprogname());
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Read "event device parent" lines instead of drvctl(4) events, to
+ * drive the broker and its readers without real hardware.
+ */
+static int
+sim_recv(FILE *fp, prop_dictionary_t *evp)
+{
+	char event[64], device[64], parent[64];
+	char line[256];
+	prop_dictionary_t ev;
+
+	for (;;) {
+		if (fgets(line, sizeof(line), fp) == NULL)
+			return -1;
+		parent[0] = '\0';
+		if (sscanf(line, "%63s %63s %63s", event, device, parent) >= 2)
+			break;
+	}
+
+	ev = prop_dictionary_create();
+	if (ev == NULL)
+		return -1;
+
+	if (!prop_dictionary_set_cstring(ev, "event", event) ||
+	    !prop_dictionary_set_cstring(ev, "device", device) ||
+	    !prop_dictionary_set_cstring(ev, "parent", parent)) {
+		prop_object_release(ev);
+		return -1;
+	}
+
+	*evp = ev;
+
+	return 0;
+}
+
+/*
+ * Publish ev.  If it does not fit a slot, publish just what the
+ * monitors need to tell the event.
+ */
+static void
+publish(struct xdev_ring *r, prop_dictionary_t ev)
+{
+	prop_dictionary_t small;
+	const char *event, *device, *parent;
+	char *xml;
+	int ret;
+
+	xml = prop_dictionary_externalize(ev);
+	if (xml == NULL) {
+		syslog(LOG_WARNING, "externalize: %m");
+		return;
+	}
+
+	ret = xdev_ring_put(r, xml, strlen(xml));
+	free(xml);
+	if (ret == 0 || errno != E2BIG)
+		return;
+
+	if (!prop_dictionary_get_cstring_nocopy(ev, "event", &event) ||
+	    !prop_dictionary_get_cstring_nocopy(ev, "device", &device) ||
+	    !prop_dictionary_get_cstring_nocopy(ev, "parent", &parent))
+		return;
+
+	small = prop_dictionary_create();
+	if (small == NULL)
+		return;
+
+	if (prop_dictionary_set_cstring_nocopy(small, "event", event) &&
+	    prop_dictionary_set_cstring_nocopy(small, "device", device) &&
+	    prop_dictionary_set_cstring_nocopy(small, "parent", parent)) {
+		xml = prop_dictionary_externalize(small);
+		if (xml != NULL) {
+			if (xdev_ring_put(r, xml, strlen(xml)) == -1)
+				syslog(LOG_WARNING, "%s: %m", device);
+			free(xml);
+		}
+	}
+
+	prop_object_release(small);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct xdev_ring r;
+	prop_dictionary_t ev;
+	const char *path;
+	const char *errstr;
+	bool foreground, sim;
+	uint32_t slots;
+	int ch, fd, ret;
+
+	foreground = false;
+	sim = false;
+	path = XDEV_RING_PATH;
+	slots = XDEV_RING_SLOTS;
+	fd = -1;
+
+	while ((ch = getopt(argc, argv, "dn:r:s")) != -1) {
+		switch (ch) {
+		case 'd':
+			foreground = true;
+			break;
+		case 'n':
+			slots = (uint32_t)strtonum(optarg, 1, 1 << 20, &errstr);
+			if (errstr != NULL)
+				errx(EXIT_FAILURE, "slots %s: %s", errstr,
+				    optarg);
+			break;
+		case 'r':
+			path = optarg;
+			break;
+		case 's':
+			sim = true;
+			foreground = true;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (argc != optind)
+		usage();
+
+	if (!sim) {
+		fd = open(DRVCTLDEV, O_RDWR | O_CLOEXEC);
+		if (fd == -1)
+			err(EXIT_FAILURE, "%s", DRVCTLDEV);
+	}
+
+	if (xdev_ring_create(&r, path, slots) == -1)
+		err(EXIT_FAILURE, "%s", path);
+
+	openlog(getprogname(), LOG_PID | (foreground ? LOG_PERROR : 0),
+	    LOG_DAEMON);
+
+	if (!foreground) {
+		if (daemon(0, 0) == -1)
+			err(EXIT_FAILURE, "daemon");
+		pidfile(NULL);
+	}
+
+	for (;;) {
+		if (sim) {
+			if (sim_recv(stdin, &ev) == -1)
+				break;
+		} else {
+			ret = prop_dictionary_recv_ioctl(fd, DRVGETEVENT, &ev);
+			if (ret == EINTR)
+				continue;
+			if (ret != 0) {
+				errno = ret;
+				syslog(LOG_ERR, "%s: %m", DRVCTLDEV);
+				break;
+			}
+		}
+
+		publish(&r, ev);
+		prop_object_release(ev);
+	}
+
+	/* Readers keep what is mapped; new ones get to know we are gone. */
+	unlink(path);
+	xdev_ring_close(&r);
+
+	return sim ? EXIT_SUCCESS : EXIT_FAILURE;
+}